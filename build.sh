@@ -1 +1 @@
-g++ main.cpp -O3 -std=c++17 -I/usr/include/X11 -lX11 -o minigui.out
+g++ main.cpp -O3 -std=c++17 -I/usr/include/X11 -lX11 -lXext -pthread -o minigui.out
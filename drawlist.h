@@ -0,0 +1,79 @@
+#pragma once
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include "graphics_base.h"
+
+//Recorded draw calls of the SoftwareRenderer.
+//The commands and their image data live in two growing arrays that keep their capacity between frames.
+
+enum class DrawOp : unsigned char { FilledRect, Line, HLine, VLine, BlendMask, CopyImage, Ellipse, FilledEllipse, Triangle, Composite };
+
+//One draw call. Plain data without padding, so lists can be copied and compared bytewise.
+struct DrawCmd
+{
+	DrawOp        op;
+	Color8        col;
+	unsigned char mode;           //the CompositeOp of Composite
+	unsigned char reserved[2];
+	int           x0, y0, x1, y1; //geometry, meaning depends on op (see SoftwareRenderer::execute)
+	rect2i        bounds;         //pixels that may be touched, already clipped to the target
+	unsigned int  payload;        //offset of the image data (BlendMask, CopyImage, Composite) or vertices (Triangle) in the arena
+};
+
+struct DrawList
+{
+	std::vector<DrawCmd>       cmds;
+	std::vector<unsigned char> arena;
+
+	void clear(){ cmds.clear(); arena.clear(); }
+	bool empty() const { return cmds.empty(); }
+	size_t size() const { return cmds.size(); }
+
+	//reserves n bytes in the arena and returns their offset:
+	unsigned int allocate(size_t n){ auto at = arena.size(); arena.resize(at + n); return (unsigned int)at; }
+
+	unsigned char*       bytes(unsigned int offset)       { return arena.data() + offset; }
+	unsigned char const* bytes(unsigned int offset) const { return arena.data() + offset; }
+
+	//size of the image data belonging to a command:
+	static size_t payload_size(DrawCmd const& c)
+	{
+		if     (c.op == DrawOp::BlendMask){ return (size_t)c.x1 * (size_t)c.y1; }
+		else if(c.op == DrawOp::CopyImage || c.op == DrawOp::Composite){ return (size_t)c.x1 * (size_t)c.y1 * sizeof(Color8); }
+		else if(c.op == DrawOp::Triangle ){ return 6 * sizeof(int32_t); }
+		return 0;
+	}
+
+	bool same_as(DrawList const& o) const
+	{
+		return cmds.size() == o.cmds.size() && arena.size() == o.arena.size()
+			&& (cmds.empty()  || memcmp(cmds.data(),  o.cmds.data(),  cmds.size() * sizeof(DrawCmd)) == 0)
+			&& (arena.empty() || memcmp(arena.data(), o.arena.data(), arena.size()) == 0);
+	}
+};
+
+//Compares two commands with their image data, ignoring where the data is in the arena:
+inline bool same_command(DrawCmd a, DrawList const& la, DrawCmd b, DrawList const& lb)
+{
+	auto pa = a.payload, pb = b.payload;
+	a.payload = b.payload = 0;
+	if(memcmp(&a, &b, sizeof(DrawCmd)) != 0){ return false; }
+	auto n = DrawList::payload_size(a);
+	return n == 0 || memcmp(la.bytes(pa), lb.bytes(pb), n) == 0;
+}
+
+//The pixels that may differ between rasterizing a and b (on top of the same content):
+//the bounds of both versions of every command that differs at the same position in the lists.
+inline region2i difference(DrawList const& a, DrawList const& b)
+{
+	region2i d;
+	size_t n = std::min(a.size(), b.size());
+	for(size_t i=0; i<n; ++i)
+	{
+		if(!same_command(a.cmds[i], a, b.cmds[i], b)){ d.add(a.cmds[i].bounds); d.add(b.cmds[i].bounds); }
+	}
+	for(size_t i=n; i<a.size(); ++i){ d.add(a.cmds[i].bounds); }
+	for(size_t i=n; i<b.size(); ++i){ d.add(b.cmds[i].bounds); }
+	return d;
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include "graphics_base.h"
+
+//Per-frame phase profiler. Enabled by defining MINIGUI_PROFILE, otherwise every macro below expands to nothing
+//and the profiler does not exist at all.
+//
+//MINIGUI_PROFILE_FRAME()               starts a new frame record
+//MINIGUI_PROFILE_PHASE(phase)          times the enclosing scope into a phase of the current frame
+//MINIGUI_PROFILE_WIDGET(ptr, name)     times the enclosing scope as the draw of one widget
+//MINIGUI_PROFILE_HUD(renderer, rect)   draws the frame time graph of the recent frames
+//
+//Records live in fixed rings written with atomics only, so the event and the render thread may both write,
+//and a reader may see the record being overwritten when it lags a whole ring behind.
+
+#ifdef MINIGUI_PROFILE
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+struct FrameProfiler
+{
+	using clock = std::chrono::steady_clock;
+	enum Phase : int { Update, Realign, Draw, Present, Frame, PhaseCount };
+	static constexpr int nFrames  = 128;
+	static constexpr int nWidgets = 1024;
+
+	struct FrameRecord
+	{
+		std::atomic<uint64_t> frame;
+		std::atomic<uint32_t> us[PhaseCount];
+	};
+
+	struct WidgetRecord
+	{
+		std::atomic<uint64_t>    frame;
+		std::atomic<const void*> id;
+		std::atomic<const char*> name;
+		std::atomic<uint32_t>    us;
+	};
+
+	FrameRecord           frames[nFrames];
+	WidgetRecord          widgets[nWidgets];
+	std::atomic<uint64_t> current, nextWidget;
+
+	FrameProfiler():current{0}, nextWidget{0}
+	{
+		for(auto& f : frames){ f.frame = 0; for(auto& u : f.us){ u = 0; } }
+		for(auto& w : widgets){ w.frame = 0; w.id = nullptr; w.name = nullptr; w.us = 0; }
+	}
+
+	static FrameProfiler& instance(){ static FrameProfiler p; return p; }
+
+	void beginFrame()
+	{
+		auto f = current.load(std::memory_order_relaxed) + 1;
+		auto& r = frames[f % nFrames];
+		for(auto& u : r.us){ u.store(0, std::memory_order_relaxed); }
+		r.frame.store(f, std::memory_order_relaxed);
+		current.store(f, std::memory_order_release);
+	}
+
+	void add(Phase p, uint32_t us)
+	{
+		auto f = current.load(std::memory_order_acquire);
+		frames[f % nFrames].us[p].fetch_add(us, std::memory_order_relaxed);
+	}
+
+	void addWidget(const void* id, const char* name, uint32_t us)
+	{
+		auto& w = widgets[nextWidget.fetch_add(1, std::memory_order_relaxed) % nWidgets];
+		w.id.store(id, std::memory_order_relaxed);
+		w.name.store(name, std::memory_order_relaxed);
+		w.us.store(us, std::memory_order_relaxed);
+		w.frame.store(current.load(std::memory_order_relaxed), std::memory_order_release);
+	}
+
+	//ms spent in phase p during frame f, 0 when f is not in the ring anymore:
+	double phaseMs(uint64_t f, Phase p) const
+	{
+		auto const& r = frames[f % nFrames];
+		return r.frame.load(std::memory_order_acquire) == f ? r.us[p].load(std::memory_order_relaxed) / 1000.0 : 0.0;
+	}
+
+	//calls f(id, name, ms) for the widget draws recorded in frame fr:
+	template<typename F>
+	void forWidgets(uint64_t fr, F&& f) const
+	{
+		for(auto const& w : widgets)
+		{
+			if(w.frame.load(std::memory_order_acquire) == fr){ f(w.id.load(std::memory_order_relaxed), w.name.load(std::memory_order_relaxed), w.us.load(std::memory_order_relaxed) / 1000.0); }
+		}
+	}
+
+	struct PhaseScope
+	{
+		Phase p; clock::time_point t0;
+		PhaseScope(Phase p_):p{p_}, t0{clock::now()}{}
+		~PhaseScope(){ instance().add(p, (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - t0).count()); }
+	};
+
+	struct WidgetScope
+	{
+		const void* id; const char* name; clock::time_point t0;
+		WidgetScope(const void* id_, const char* name_):id{id_}, name{name_}, t0{clock::now()}{}
+		~WidgetScope(){ instance().addWidget(id, name, (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - t0).count()); }
+	};
+
+	//Bars: total frame times of the completed frames in the ring, line: their draw phase, both scaled to their own range:
+	template<typename R>
+	void drawHud(R& r, rect2i rc) const
+	{
+		auto last = current.load(std::memory_order_acquire);
+		if(last < 3){ return; }
+		int n = (int)std::min<uint64_t>(last - 1, (uint64_t)std::min(nFrames - 1, rc.w));
+		float totals[nFrames], draws[nFrames];
+		for(int i=0; i<n; ++i)
+		{
+			auto f = last - n + i;
+			totals[i] = (float)phaseMs(f, Frame);
+			draws[i]  = (float)phaseMs(f, Draw);
+		}
+		r.filledrect(rc.x, rc.y, rc.w, rc.h, color8(0, 0, 0));
+		r.rect(rc.x, rc.y, rc.w, rc.h, color8(96, 96, 96));
+		auto flat = [&](float const* v){ auto mm = std::minmax_element(v, v + n); return *mm.first == *mm.second; };
+		if(!flat(totals)){ r.barplot(rc.x + 1, rc.y + 1, rc.w - 2, rc.h - 2, totals, totals + n, color8(64, 160, 64)); }
+		if(!flat(draws)){ r.lineplot(rc.x + 1, rc.y + 1, n, rc.h - 2, 0.0f, (float)n, color8(255, 192, 0), [&](float x){ return draws[std::min(n - 1, (int)x)]; }); }
+	}
+};
+
+#define MINIGUI_PROFILE_CAT2(a, b) a##b
+#define MINIGUI_PROFILE_CAT(a, b) MINIGUI_PROFILE_CAT2(a, b)
+#define MINIGUI_PROFILE_FRAME() FrameProfiler::instance().beginFrame()
+#define MINIGUI_PROFILE_PHASE(phase) FrameProfiler::PhaseScope MINIGUI_PROFILE_CAT(minigui_profile_, __LINE__)(FrameProfiler::phase)
+#define MINIGUI_PROFILE_WIDGET(ptr, name) FrameProfiler::WidgetScope MINIGUI_PROFILE_CAT(minigui_profile_, __LINE__)(ptr, name)
+#define MINIGUI_PROFILE_HUD(renderer, rc) FrameProfiler::instance().drawHud(renderer, rc)
+#else
+#define MINIGUI_PROFILE_FRAME()
+#define MINIGUI_PROFILE_PHASE(phase)
+#define MINIGUI_PROFILE_WIDGET(ptr, name)
+#define MINIGUI_PROFILE_HUD(renderer, rc)
+#endif
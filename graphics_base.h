@@ -3,6 +3,9 @@
 #include <vector>
 #include <array>
 #include <algorithm>
+#include <limits>
+#include <new>
+#include <type_traits>
 
 using byte = unsigned char;
 
@@ -130,6 +133,14 @@ bool is_inside( rect2<T> r, T x, T y )
 	return false;
 }
 template<typename T> bool    is_inside ( rect2<T>  r, pos2<T> p ){ return is_inside(r, p.x, p.y); }
+
+//pixel containment, the right and bottom edges are excluded:
+template<typename T>
+bool is_inside_half_open( rect2<T> r, T x, T y )
+{
+	return r.x <= x && x < r.x + r.w && r.y <= y && y < r.y + r.h;
+}
+
 template<typename T> T       get_center( T x, T w ){ return x + w / 2; }
 template<typename T> pos2<T> get_center( rect2<T>  r            ){ return pos2<T>{r.x + r.w/2, r.y + r.h/2}; }
 template<typename T> void    center_to ( T& x, T w, T p ){ x = p - w / 2; }
@@ -160,6 +171,82 @@ auto intersect( rect2<T> a, rect2<T> b )
 	return rect2<T>{p.x, p.y, q.x-p.x, q.y-p.y};
 }
 
+//smallest rect containing both:
+template<typename T>
+auto unite( rect2<T> a, rect2<T> b )
+{
+	pos2<T> p = {std::min( left(a),  left(b)), std::min(   top(a),    top(b))};
+	pos2<T> q = {std::max(right(a), right(b)), std::max(bottom(a), bottom(b))};
+	return rect2<T>{p.x, p.y, q.x-p.x, q.y-p.y};
+}
+
+template<typename T> bool overlaps( rect2<T> a, rect2<T> b ){ auto r = intersect(a, b); return r.w > 0 && r.h > 0; }
+template<typename T> bool contains( rect2<T> a, rect2<T> b ){ return left(a) <= left(b) && top(a) <= top(b) && right(b) <= right(a) && bottom(b) <= bottom(a); }
+
+//A set of non-overlapping rects. Overlapping rects are merged, and so are neighbours whose union does not cover
+//more than the two of them, so the list stays short. Above max_rects the pair wasting the least area is merged.
+template<typename T>
+struct region2
+{
+	static constexpr int max_rects = 16;
+	std::vector<rect2<T>> rects;
+
+	bool empty() const { return rects.empty(); }
+	void clear(){ rects.clear(); }
+
+	T area() const { T a = (T)0; for(auto const& r : rects){ a += r.area(); } return a; }
+
+	rect2<T> bounds() const
+	{
+		if(rects.empty()){ return rect2<T>{(T)0, (T)0, (T)0, (T)0}; }
+		auto b = rects[0];
+		for(auto const& r : rects){ b = unite(b, r); }
+		return b;
+	}
+
+	void add(rect2<T> r)
+	{
+		if(r.w <= 0 || r.h <= 0){ return; }
+		for(size_t i=0; i<rects.size(); )
+		{
+			auto const& e = rects[i];
+			if(contains(e, r)){ return; }
+			auto u = unite(e, r);
+			if(overlaps(e, r) || u.area() <= e.area() + r.area())
+			{
+				r = u;
+				rects.erase(rects.begin() + i);
+				i = 0;
+				continue;
+			}
+			++i;
+		}
+		rects.push_back(r);
+
+		if((int)rects.size() > max_rects)
+		{
+			size_t bi = 0, bj = 1;
+			T best = std::numeric_limits<T>::max();
+			for(size_t i=0; i<rects.size(); ++i)
+			{
+				for(size_t j=i+1; j<rects.size(); ++j)
+				{
+					T waste = unite(rects[i], rects[j]).area() - rects[i].area() - rects[j].area();
+					if(waste < best){ best = waste; bi = i; bj = j; }
+				}
+			}
+			auto u = unite(rects[bi], rects[bj]);
+			rects.erase(rects.begin() + bj);
+			rects.erase(rects.begin() + bi);
+			add(u);
+		}
+	}
+
+	void add(region2<T> const& o){ for(auto const& r : o.rects){ add(r); } }
+};
+
+using region2i = region2<int>;
+
 template<typename T>
 void center_shrink( T& x, T& w, T gap )
 {
@@ -236,6 +323,54 @@ Color8 blend8(Color8 dst, unsigned char alpha, Color8 src)
 	return {(T)(b/255), (T)(g/255), (T)(r/255), (T)(a/255)};
 }
 
+//Premultiplied alpha: the color channels are stored already scaled by alpha, so compositing needs no division by alpha.
+//x/255 rounded, exact for x <= 255*255:
+unsigned short div255(unsigned int x){ x += 128; return (unsigned short)((x + (x >> 8)) >> 8); }
+
+Color8 premultiply(Color8 c)
+{
+	using T = unsigned char;
+	return {(T)div255(c.b * c.a), (T)div255(c.g * c.a), (T)div255(c.r * c.a), c.a};
+}
+
+Color8 unpremultiply(Color8 c)
+{
+	if(c.a == 0){ return {0, 0, 0, 0}; }
+	using T = unsigned char;
+	auto f = [a = (unsigned int)c.a](unsigned int v){ return (T)std::min(255u, (v * 255 + a / 2) / a); };
+	return {f(c.b), f(c.g), f(c.r), c.a};
+}
+
+//Composite operators on premultiplied colors, src is drawn onto dst:
+//Copy: src, SrcOver: src + dst*(1-src.a), Add: saturated src + dst,
+//Multiply: src*dst + src*(1-dst.a) + dst*(1-src.a) (applied to alpha too, which gives the src-over alpha).
+enum class CompositeOp : unsigned char { Copy, SrcOver, Add, Multiply };
+
+//Per channel, in the 16 bit arithmetic the SIMD kernels use:
+unsigned char composite_channel(CompositeOp op, unsigned int d, unsigned int s, unsigned int da, unsigned int sa)
+{
+	auto sat16 = [](unsigned int x){ return std::min(x, 65535u); };
+	switch(op)
+	{
+	case CompositeOp::Copy:     return (unsigned char)s;
+	case CompositeOp::SrcOver:  return (unsigned char)std::min(255u, s + div255(d * (255 - sa)));
+	case CompositeOp::Add:      return (unsigned char)std::min(255u, s + d);
+	case CompositeOp::Multiply:
+	{
+		unsigned int x = sat16((unsigned short)(s * (unsigned short)(255 - da + d)) + (unsigned int)(unsigned short)(d * (255 - sa)));
+		x = sat16(x + 128);
+		return (unsigned char)std::min(255u, sat16(x + (x >> 8)) >> 8);
+	}
+	}
+	return (unsigned char)d;
+}
+
+Color8 composite8(CompositeOp op, Color8 dst, Color8 src)
+{
+	return {composite_channel(op, dst.b, src.b, dst.a, src.a), composite_channel(op, dst.g, src.g, dst.a, src.a),
+	        composite_channel(op, dst.r, src.r, dst.a, src.a), composite_channel(op, dst.a, src.a, dst.a, src.a)};
+}
+
 template<typename T>
 Color<T> recolor(T A, Color<T> bk, Color<T> fg)
 {
@@ -261,11 +396,63 @@ template<typename T> unsigned long packed_color(Color<T> const& c){ return RGB((
 template<typename T> unsigned long packed_color(Color<T> const& c){ return ((((unsigned long)c.a*256 + (unsigned long)c.r)*256)+(unsigned long)c.g)*256+(unsigned long)c.b; }
 #endif
 
+//Where image pixels live, e.g. a shared memory segment the display server can read directly.
+struct PixelArena
+{
+	virtual void* allocate(size_t bytes) = 0;
+	virtual void  deallocate(void* p, size_t bytes) = 0;
+	virtual ~PixelArena(){}
+};
+
+//Hands out one preallocated block, larger or further requests go to the heap:
+struct BlockArena : PixelArena
+{
+	void*  base = nullptr;
+	size_t size = 0;
+	bool   used = false;
+
+	void reset(void* base_, size_t size_){ base = base_; size = size_; used = false; }
+	bool owns(void const* p) const { return p != nullptr && p == base; }
+
+	void* allocate(size_t bytes) override
+	{
+		if(!used && base && bytes <= size){ used = true; return base; }
+		return ::operator new(bytes);
+	}
+	void deallocate(void* p, size_t) override
+	{
+		if(owns(p)){ used = false; }
+		else       { ::operator delete(p); }
+	}
+};
+
+//Heap allocation unless an arena is given. Copies of an image always go to the heap.
+template<typename C>
+struct PixelAllocator
+{
+	using value_type = C;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap            = std::true_type;
+
+	PixelArena* arena;
+
+	PixelAllocator():arena{nullptr}{}
+	PixelAllocator(PixelArena* a):arena{a}{}
+	template<typename U> PixelAllocator(PixelAllocator<U> const& o):arena{o.arena}{}
+
+	C*   allocate(size_t n){ return (C*)(arena ? arena->allocate(n * sizeof(C)) : ::operator new(n * sizeof(C))); }
+	void deallocate(C* p, size_t n){ if(arena){ arena->deallocate(p, n * sizeof(C)); } else { ::operator delete(p); } }
+	PixelAllocator select_on_container_copy_construction() const { return {}; }
+
+	template<typename U> bool operator==(PixelAllocator<U> const& o) const { return arena == o.arena; }
+	template<typename U> bool operator!=(PixelAllocator<U> const& o) const { return arena != o.arena; }
+};
+
 template<typename C>
 struct Image2
 {
 	size2<int> sz;
-	std::vector<C> data;
+	std::vector<C, PixelAllocator<C>> data;
 
 	Image2():sz{0, 0}, data{}{}
 
@@ -277,6 +464,18 @@ struct Image2
 	void resize(size2<int> sz_)       { data.resize((size_t)sz_.area()     ); sz = sz_; }
 	void resize(size2<int> sz_, C val){ data.resize((size_t)sz_.area(), val); sz = sz_; }
 
+	//resize never gives memory back, reserve sets the capacity to n pixels exactly (not below the size), keeping the content:
+	size_t capacity() const { return data.capacity(); }
+	void reserve(size_t n)
+	{
+		n = std::max(n, data.size());
+		if(n == data.capacity()){ return; }
+		decltype(data) d(data.get_allocator());
+		d.reserve(n);
+		d.assign(data.begin(), data.end());
+		data.swap(d);
+	}
+
 	C &      operator()(int x, int y)      { return data[(size_t)y*(size_t)sz.w+(size_t)x]; }
 	C const& operator()(int x, int y)const { return data[(size_t)y*(size_t)sz.w+(size_t)x]; }
 
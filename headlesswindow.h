@@ -0,0 +1,130 @@
+#pragma once
+#include <deque>
+#include "miniwindow.h"
+
+//Offscreen counterpart of MainWindow with the same handler API, but without any display connection.
+//Time is synthetic: advance() moves the clock, delivers the injected events that became due through the relay,
+//and renders frames at the frame interval while something is dirty. The backbuffer is readable after any frame.
+struct HeadlessWindow
+{
+	//stands in for PlatformWindowData, so handlers may call window.redraw() or read window.size the same way:
+	struct Platform
+	{
+		size2<int> size;
+		bool eventDriven, dirty, isQuit;
+		Platform():size{0, 0}, eventDriven{true}, dirty{false}, isQuit{false}{}
+		void redraw(){ dirty = true; }
+		void quit(){ isQuit = true; }
+	};
+
+	Platform                window;
+	SoftwareRenderer        renderer;
+	double                  now;       //ms on the synthetic clock
+	double                  frameTime; //ms between frames
+	long                    frames;
+	std::deque<InputEvent>  events;    //ordered by time
+
+	std::function<void(void)> onAppStep, onAppExit;
+	std::function<void(int, int, bool)> onAppResize;
+	std::function<void(SoftwareRenderer&)> onAppRender;
+	HeadlessWindow():now{0.0}, frameTime{1000.0 / 60.0}, frames{0}, onAppStep{[]{}}, onAppExit{[]{}}, onAppResize{[](int, int, bool){}}, onAppRender{[](SoftwareRenderer&){}}{}
+
+	auto width() const { return window.size.w; }
+	auto height() const { return window.size.h; }
+	Image2<Color8> const& backbuffer() const { return renderer.backbuffer; }
+
+	template<typename FInit>
+	bool open(size2<int> size_, FInit&& finit)
+	{
+		using namespace MainWindowDetails;
+		relay.onRender = [&]{ this->onRender(); };
+		relay.onExit   = [&]{ this->onExit(); };
+		relay.onResize = [&](int w, int h, bool m){ this->onResize(w, h, m); };
+
+		window.size = size_;
+		window.isQuit = false;
+		renderer.init(width(), height());
+		onAppResize(width(), height(), true);
+		if( !finit() ){ return false; }
+		window.redraw();
+		return true;
+	}
+
+	void close(){ renderer.close(); }
+	void quit(){ window.quit(); }
+	bool isQuit() const { return window.isQuit; }
+
+	template<typename F> void      exitHandler(F&& f){ onAppExit   = std::forward<F>(f); }
+	template<typename F> void      idleHandler(F&& f){ onAppStep   = std::forward<F>(f); }
+	template<typename F> void    renderHandler(F&& f){ onAppRender = std::forward<F>(f); }
+	template<typename F> void    resizeHandler(F&& f){ onAppResize = std::forward<F>(f); }
+	template<typename F> void     mouseHandler(F&& f){ MainWindowDetails::relay.onMouseEvent    = std::forward<F>(f); }
+	template<typename F> void  keyboardHandler(F&& f){ MainWindowDetails::relay.onKeyboardEvent = std::forward<F>(f); }
+
+	//events with a time earlier than the clock are delivered at the next advance:
+	void inject(InputEvent const& e)
+	{
+		auto it = std::upper_bound(events.begin(), events.end(), e.t, [](double t, InputEvent const& x){ return t < x.t; });
+		events.insert(it, e);
+	}
+	template<typename It> void inject(It first, It last){ for(; first != last; ++first){ inject(*first); } }
+
+	//moves the clock by dt ms, one frame interval at a time, returns the number of frames rendered:
+	long advance(double dt)
+	{
+		long n0 = frames;
+		double end = now + dt;
+		while(now < end && !window.isQuit)
+		{
+			now = std::min(end, now + frameTime);
+			while(!events.empty() && events.front().t <= now && !window.isQuit)
+			{
+				auto e = std::move(events.front()); events.pop_front();
+				MainWindowDetails::relay.dispatch(e);
+				if(window.eventDriven){ window.dirty = true; }
+			}
+			if(!window.eventDriven){ onAppStep(); window.dirty = true; }
+			if(window.dirty && !window.isQuit){ MainWindowDetails::relay.onRender(); }
+		}
+		return frames - n0;
+	}
+
+	//runs until the event queue is drained and nothing is dirty:
+	long run()
+	{
+		long n0 = frames;
+		while(!window.isQuit && (!events.empty() || window.dirty)){ advance(events.empty() ? frameTime : std::max(frameTime, events.front().t - now)); }
+		return frames - n0;
+	}
+
+	//renders one frame regardless of the dirty state, e.g. for benchmarking:
+	void frame(){ window.dirty = true; MainWindowDetails::relay.onRender(); }
+
+	void onRender()
+	{
+		if(window.size.area() == 0){ return; }
+		MINIGUI_PROFILE_FRAME();
+		MINIGUI_PROFILE_PHASE(Frame);
+		renderer.beginFrame();
+		onAppRender(renderer);
+		renderer.endFrame();
+		renderer.flush();
+		renderer.clearDamage();
+		window.dirty = false;
+		frames += 1;
+	}
+
+	void onResize(int w, int h, bool)
+	{
+		bool m = (w == width()) && (h == height());
+		if(!m)
+		{
+			renderer.resize(w, h);
+			window.size.w = w; window.size.h = h;
+		}
+		onAppResize(w, h, m);
+		if(!m){ window.redraw(); }
+	}
+
+	void onExit(){ onAppExit(); }
+};
@@ -0,0 +1,207 @@
+#pragma once
+#include <stdio.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "miniwindow.h"
+
+//Input sessions as repeatable workloads: InputRecorder taps the relay and stores the timestamped event stream,
+//InputReplayer feeds a stream back through the relay and measures every frame rendered meanwhile.
+
+//File layout (little endian): "MGIN", u32 version, u32 count, then per event
+//u32 dt in microseconds since the previous event, u8 type, u8 change, i32 x, i32 y,
+//and for Char events a u16 byte count followed by the utf-8 bytes.
+namespace InputLog
+{
+	static const char     magic[4] = {'M', 'G', 'I', 'N'};
+	static const uint32_t version  = 1;
+
+	template<typename T> static void put(FILE* f, T v){ fwrite(&v, sizeof(T), 1, f); }
+	template<typename T> static bool get(FILE* f, T& v){ return fread(&v, sizeof(T), 1, f) == 1; }
+
+	static bool save(std::string const& path, std::vector<InputEvent> const& events)
+	{
+		FILE* f = fopen(path.c_str(), "wb");
+		if(!f){ printf("Cannot open input log for writing: %s\n", path.c_str()); return false; }
+		fwrite(magic, 1, 4, f);
+		put<uint32_t>(f, version);
+		put<uint32_t>(f, (uint32_t)events.size());
+		double last = 0.0;
+		for(auto const& e : events)
+		{
+			auto dt = (uint32_t)std::max(0.0, std::round((e.t - last) * 1000.0));
+			last += dt / 1000.0;
+			put<uint32_t>(f, dt);
+			put<uint8_t>(f, (uint8_t)e.type);
+			put<uint8_t>(f, e.change == ButtonChange::Down ? 1 : 0);
+			put<int32_t>(f, e.x);
+			put<int32_t>(f, e.y);
+			if(e.type == InputEvent::Char)
+			{
+				auto n = (uint16_t)std::min<size_t>(e.ch.repr.size(), 0xFFFF);
+				put<uint16_t>(f, n);
+				fwrite(e.ch.repr.data(), 1, n, f);
+			}
+		}
+		bool ok = ferror(f) == 0;
+		fclose(f);
+		return ok;
+	}
+
+	static bool load(std::string const& path, std::vector<InputEvent>& events)
+	{
+		FILE* f = fopen(path.c_str(), "rb");
+		if(!f){ printf("Cannot open input log: %s\n", path.c_str()); return false; }
+		char m[4]; uint32_t ver = 0, n = 0;
+		bool ok = fread(m, 1, 4, f) == 4 && std::equal(m, m + 4, magic) && get(f, ver) && ver == version && get(f, n);
+		if(!ok){ printf("Not an input log: %s\n", path.c_str()); fclose(f); return false; }
+
+		events.clear();
+		events.reserve(n);
+		double t = 0.0;
+		for(uint32_t i=0; i<n && ok; ++i)
+		{
+			uint32_t dt; uint8_t type, change; int32_t x, y;
+			ok = get(f, dt) && get(f, type) && get(f, change) && get(f, x) && get(f, y) && type <= (uint8_t)InputEvent::Exit;
+			if(!ok){ break; }
+			t += dt / 1000.0;
+			InputEvent e(t, (InputEvent::Type)type, x, y, change ? ButtonChange::Down : ButtonChange::Up);
+			if(e.type == InputEvent::Char)
+			{
+				uint16_t len;
+				ok = get(f, len);
+				e.ch.repr.resize(len);
+				ok = ok && fread(&e.ch.repr[0], 1, len, f) == len;
+			}
+			events.push_back(std::move(e));
+		}
+		fclose(f);
+		if(!ok){ printf("Truncated input log: %s\n", path.c_str()); }
+		return ok;
+	}
+}
+
+struct InputRecorder
+{
+	using clock = std::chrono::steady_clock;
+
+	std::vector<InputEvent> events;
+	clock::time_point       t0;
+	std::function<double(void)> time; //ms, the wall clock by default, a HeadlessWindow passes its synthetic clock
+	std::function<void(InputEvent const&)> previous;
+	bool                    active;
+
+	InputRecorder():active{false}{}
+	~InputRecorder(){ stop(); }
+
+	void start(std::function<double(void)> time_ = nullptr)
+	{
+		if(active){ return; }
+		using namespace MainWindowDetails;
+		events.clear();
+		t0 = clock::now();
+		time = time_ ? std::move(time_) : [this]{ return std::chrono::duration<double, std::milli>(clock::now() - t0).count(); };
+		previous = relay.onInput;
+		relay.onInput = [this](InputEvent const& e)
+		{
+			events.push_back(e);
+			events.back().t = time();
+			if(previous){ previous(e); }
+		};
+		active = true;
+	}
+
+	void stop()
+	{
+		if(!active){ return; }
+		MainWindowDetails::relay.onInput = previous;
+		previous = nullptr;
+		active = false;
+	}
+
+	bool save(std::string const& path) const { return InputLog::save(path, events); }
+};
+
+struct InputReplayer
+{
+	using clock = std::chrono::steady_clock;
+
+	std::vector<InputEvent> events;
+	size_t                  next;
+	std::vector<double>     frameMs;  //wall time of each frame rendered while measuring
+	std::function<void(void)> previous;
+	bool                    measuring;
+
+	InputReplayer():next{0}, measuring{false}{}
+	~InputReplayer(){ end(); }
+
+	bool load(std::string const& path){ next = 0; return InputLog::load(path, events); }
+	bool done() const { return next >= events.size(); }
+	double duration() const { return events.empty() ? 0.0 : events.back().t; }
+
+	//starts measuring the frames, the relay must already be set up by the window:
+	void begin()
+	{
+		if(measuring){ return; }
+		using namespace MainWindowDetails;
+		next = 0;
+		frameMs.clear();
+		previous = relay.onRender;
+		relay.onRender = [this]
+		{
+			auto t = clock::now();
+			previous();
+			frameMs.push_back(std::chrono::duration<double, std::milli>(clock::now() - t).count());
+		};
+		measuring = true;
+	}
+
+	void end()
+	{
+		if(!measuring){ return; }
+		MainWindowDetails::relay.onRender = previous;
+		previous = nullptr;
+		measuring = false;
+	}
+
+	//Original speed: dispatches the events due at t ms after the start of the replay.
+	//Call it from the idle handler of a non event driven window with the elapsed time.
+	size_t pump(double t)
+	{
+		size_t n0 = next;
+		while(next < events.size() && events[next].t <= t){ MainWindowDetails::relay.dispatch(events[next++]); }
+		return next - n0;
+	}
+
+	//Maximum speed: dispatches the events that originally arrived within one frame interval, whatever the clock says.
+	size_t pumpFrame(double frameTime)
+	{
+		if(done()){ return 0; }
+		return pump(events[next].t + frameTime);
+	}
+
+	//Replays into a HeadlessWindow-like target on its synthetic clock:
+	template<typename W>
+	long replay(W& w)
+	{
+		begin();
+		for(auto e : events){ e.t += w.now; w.inject(e); }
+		next = events.size();
+		long n = w.run();
+		end();
+		return n;
+	}
+
+	void report() const
+	{
+		if(frameMs.empty()){ printf("Replay: no frames\n"); return; }
+		auto v = frameMs;
+		std::sort(v.begin(), v.end());
+		double sum = 0.0; for(auto x : v){ sum += x; }
+		auto pct = [&](double p){ return v[std::min(v.size() - 1, (size_t)(p * (v.size() - 1) + 0.5))]; };
+		printf("Replay: %zu events, %zu frames, mean %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+		       events.size(), v.size(), sum / v.size(), pct(0.5), pct(0.95), pct(0.99), v.back());
+	}
+};
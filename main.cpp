@@ -45,7 +45,7 @@ struct App
 
 		staticText.font = &style.font;
 		staticText.height = 26;
-		staticText.text = utf8string(utf8s("My static text")).to_codepoints();
+		staticText.setText(utf8s("My static text"));
 
 		text1   = utf8s("Quit").to_codepoints();
 		counter = 0;
@@ -126,39 +126,35 @@ struct App
 				int w = wnd.width();
 				int h = wnd.height();
 				
-				wnd.renderer.filledrect(0, 0, w, h, color8(0, 0, 0));
+				r.clear(color8(0, 0, 0));
 
-				uiCounter.updateContent();
-				uiCounter.realign(pos2i{(int)(w * 0.125f), (int)(h * 0.225)}, {});
-				uiCounter.draw(r);
+				//the three phases of a root widget, each timed when profiling:
+				auto frame = [&](Base& widget, pos2i pos)
+				{
+					{ MINIGUI_PROFILE_PHASE(Update);  widget.updateContent(); }
+					{ MINIGUI_PROFILE_PHASE(Realign); widget.realign(pos, {}); }
+					{ MINIGUI_PROFILE_PHASE(Draw);    widget.draw(r); }
+				};
+
+				frame(uiCounter, pos2i{(int)(w * 0.125f), (int)(h * 0.225)});
 				counter += 1;
 
-				bQuit.updateContent();
-				bQuit.realign(pos2i{(int)(w * 0.055f), (int)(h * 0.055)}, {});
-				bQuit.draw(r);
+				frame(bQuit, pos2i{(int)(w * 0.055f), (int)(h * 0.055)});
 
-				staticText.updateContent();
-				staticText.realign(pos2i{(int)(w * 0.125f), (int)(h * 0.155)}, {});
-				staticText.draw(r);
+				frame(staticText, pos2i{(int)(w * 0.125f), (int)(h * 0.155)});
 
 				tworows.layout->rect = size2i{(int)(w * 0.1f), (int)(h * 0.1f)};
-				tworows.updateContent();
-				tworows.realign(pos2i{(int)(w * 0.625f), (int)(h * 0.125)}, {});
-				tworows.draw(r);
+				frame(tworows, pos2i{(int)(w * 0.625f), (int)(h * 0.125)});
 
-				tatc.updateContent();
-				tatc.realign(pos2i{(int)(w * 0.625f), (int)(h * 0.825)}, {});
-				tatc.draw(r);
+				frame(tatc, pos2i{(int)(w * 0.625f), (int)(h * 0.825)});
 
 				listd.layout->rect = size2i{(int)(w * 0.2f), (int)(h * 0.5f)};
-				listd.updateContent();
-				listd.realign(pos2i{(int)(w * 0.125f), (int)(h * 0.325)}, {});
-				listd.draw(r);
+				frame(listd, pos2i{(int)(w * 0.125f), (int)(h * 0.325)});
 				
 				list.layout->rect = size2i{(int)(w * 0.5f), (int)(h * 0.5f)};
-				list.updateContent();
-				list.realign(pos2i{(int)(w * 0.5f), (int)(h * 0.5)}, {});
-				list.draw(r);
+				frame(list, pos2i{(int)(w * 0.5f), (int)(h * 0.5)});
+
+				MINIGUI_PROFILE_HUD(r, (rect2i{w - 266, h - 90, 256, 80}));
 			});
 
 		bool res = wnd.open(utf8s("GUI Test"), {4, 64}, {(int)(800), (int)(600)}, true, false, [&]{ return true; });
@@ -5,6 +5,9 @@
 #include <vector>
 #include <chrono>
 #include <functional>
+#include <memory>
+#include <cmath>
+#include <type_traits>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -19,10 +22,24 @@
 #include <X11/Xutil.h>
 #include <X11/Xresource.h>
 #include <X11/Xlocale.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 //#include <X11/extensions/xf86vmode.h>
 #endif
 #include "utfstring.h"
 #include "graphics_base.h"
+#include "pixelkernels.h"
+#include "drawlist.h"
+#include "workerpool.h"
+#include "frameprofiler.h"
 
 enum class ButtonChange : bool {Up, Down};
 
@@ -73,6 +90,21 @@ struct Keyboard
 	Keyboard():ch{}, event{Char}, change{ButtonChange::Up}, backspace{false}, del{false}, enter{false}, up{false}, down{false}, left{false}, right{false}{}
 };
 
+//A timestamped input, as injected into or captured from the relay:
+struct InputEvent
+{
+	enum Type : unsigned char { MouseMove, MouseScroll, MouseLeft, MouseMiddle, MouseRight,
+	                            Char, Backspace, Delete, Enter, ArrowLeft, ArrowRight, ArrowUp, ArrowDown, Resize, Exit };
+	double       t;      //ms
+	Type         type;
+	ButtonChange change; //for Resize Down means the minimized flag
+	int          x, y;   //position, scroll delta in x, or size
+	utf8string   ch;
+	InputEvent():t{0.0}, type{MouseMove}, change{ButtonChange::Up}, x{0}, y{0}, ch{}{}
+	InputEvent(double t_, Type type_, int x_ = 0, int y_ = 0, ButtonChange c = ButtonChange::Up):t{t_}, type{type_}, change{c}, x{x_}, y{y_}, ch{}{}
+	InputEvent(double t_, utf8string const& ch_):t{t_}, type{Char}, change{ButtonChange::Down}, x{0}, y{0}, ch{ch_}{}
+};
+
 namespace MainWindowDetails
 {
 	struct ProcRelay
@@ -85,11 +117,54 @@ namespace MainWindowDetails
 		std::function<void(void)>            onExit;
 		std::function<void(Mouse    const&)> onMouseEvent;
 		std::function<void(Keyboard const&)> onKeyboardEvent;
+		std::function<void(rect2i)>          onExpose;
+		std::function<void(InputEvent const&)> onInput; //sees every input before it is handled, may be empty
+		std::vector<pos2<int>>               motionHistory; //positions coalesced into the current Move, oldest first
+#ifndef _WIN32
+		std::function<void(XEvent const&)>   onOtherEvent; //events Proc does not handle, e.g. extension events
+#endif
+
+		ProcRelay():onRender{[]{}}, onResize{[](int, int, bool){}}, onExit{[]{}}, onMouseEvent{[](Mouse const&){}}, onKeyboardEvent{[](Keyboard const&){}}, onExpose{[](rect2i){}}
+		{
+#ifndef _WIN32
+			onOtherEvent = [](XEvent const&){};
+#endif
+		}
+
+		void mouse_trigger   (   Mouse::Event e){ mouse.event = e;      if(onInput){ tap(mouse); }    onMouseEvent(mouse); }
+		void keyboard_trigger(Keyboard::Event e){ keyboard.event = e;   if(onInput){ tap(keyboard); } onKeyboardEvent(keyboard); }
 
-		ProcRelay():onRender{[]{}}, onResize{[](int, int, bool){}}, onExit{[]{}}, onMouseEvent{[](Mouse const&){}}, onKeyboardEvent{[](Keyboard const&){}}{}
+		void resize(int w, int h, bool f){ if(onInput){ onInput(InputEvent(0.0, InputEvent::Resize, w, h, f ? ButtonChange::Down : ButtonChange::Up)); } onResize(w, h, f); }
+		void exit(){ if(onInput){ onInput(InputEvent(0.0, InputEvent::Exit)); } onExit(); }
+
+		void tap(Mouse const& m)
+		{
+			switch(m.event)
+			{
+			case Mouse::Move:   onInput(InputEvent(0.0, InputEvent::MouseMove,   m.pos.x, m.pos.y)); break;
+			case Mouse::Scroll: onInput(InputEvent(0.0, InputEvent::MouseScroll, m.dz)); break;
+			case Mouse::Left:   onInput(InputEvent(0.0, InputEvent::MouseLeft,   0, 0, m.change)); break;
+			case Mouse::Middle: onInput(InputEvent(0.0, InputEvent::MouseMiddle, 0, 0, m.change)); break;
+			case Mouse::Right:  onInput(InputEvent(0.0, InputEvent::MouseRight,  0, 0, m.change)); break;
+			default: break;
+			}
+		}
 
-		void mouse_trigger   (   Mouse::Event e){ mouse.event = e;      onMouseEvent(mouse); }
-		void keyboard_trigger(Keyboard::Event e){ keyboard.event = e;   onKeyboardEvent(keyboard); }
+		void tap(Keyboard const& k)
+		{
+			switch(k.event)
+			{
+			case Keyboard::Char:       onInput(InputEvent(0.0, k.ch)); break;
+			case Keyboard::Backspace:  onInput(InputEvent(0.0, InputEvent::Backspace,  0, 0, k.change)); break;
+			case Keyboard::Delete:     onInput(InputEvent(0.0, InputEvent::Delete,     0, 0, k.change)); break;
+			case Keyboard::Enter:      onInput(InputEvent(0.0, InputEvent::Enter,      0, 0, k.change)); break;
+			case Keyboard::ArrowLeft:  onInput(InputEvent(0.0, InputEvent::ArrowLeft,  0, 0, k.change)); break;
+			case Keyboard::ArrowRight: onInput(InputEvent(0.0, InputEvent::ArrowRight, 0, 0, k.change)); break;
+			case Keyboard::ArrowUp:    onInput(InputEvent(0.0, InputEvent::ArrowUp,    0, 0, k.change)); break;
+			case Keyboard::ArrowDown:  onInput(InputEvent(0.0, InputEvent::ArrowDown,  0, 0, k.change)); break;
+			default: break;
+			}
+		}
 		
 		void mouse_xy    (pos2<int>   pos){ mouse.pos = pos;       mouse_trigger(Mouse::Move   ); }
 		void mouse_z     (int          dz){ mouse.dz = dz;         mouse_trigger(Mouse::Scroll ); }
@@ -105,6 +180,28 @@ namespace MainWindowDetails
 		void keyboard_right    (ButtonChange        c ){ keyboard.ChangeArrowRight(c); keyboard_trigger(Keyboard::ArrowRight); }
 		void keyboard_up       (ButtonChange        c ){ keyboard.ChangeArrowUp(c);    keyboard_trigger(Keyboard::ArrowUp); }
 		void keyboard_down     (ButtonChange        c ){ keyboard.ChangeArrowDown(c);  keyboard_trigger(Keyboard::ArrowDown); }
+
+		void dispatch(InputEvent const& e)
+		{
+			switch(e.type)
+			{
+			case InputEvent::MouseMove:   mouse_xy(pos2<int>{e.x, e.y}); break;
+			case InputEvent::MouseScroll: mouse_z(e.x);                  break;
+			case InputEvent::MouseLeft:   mouse_left(e.change);          break;
+			case InputEvent::MouseMiddle: mouse_middle(e.change);        break;
+			case InputEvent::MouseRight:  mouse_right(e.change);         break;
+			case InputEvent::Char:        keyboard_char(e.ch);           break;
+			case InputEvent::Backspace:   keyboard_backspace(e.change);  break;
+			case InputEvent::Delete:      keyboard_delete(e.change);     break;
+			case InputEvent::Enter:       keyboard_enter(e.change);      break;
+			case InputEvent::ArrowLeft:   keyboard_left(e.change);       break;
+			case InputEvent::ArrowRight:  keyboard_right(e.change);      break;
+			case InputEvent::ArrowUp:     keyboard_up(e.change);         break;
+			case InputEvent::ArrowDown:   keyboard_down(e.change);       break;
+			case InputEvent::Resize:      resize(e.x, e.y, e.change == ButtonChange::Down); break;
+			case InputEvent::Exit:        exit();                        break;
+			}
+		}
 	};
 	/*inline*/ ProcRelay relay;
 
@@ -141,8 +238,8 @@ namespace MainWindowDetails
 		}
 
 		case WM_ERASEBKGND:  return 1;
-		case WM_SIZE:        relay.onResize(LOWORD(lParam), HIWORD(lParam), wParam == SIZE_MINIMIZED); break;
-		case WM_CLOSE:     relay.onExit();   break;
+		case WM_SIZE:        relay.resize(LOWORD(lParam), HIWORD(lParam), wParam == SIZE_MINIMIZED); break;
+		case WM_CLOSE:     relay.exit();     break;
 		case WM_PAINT:     relay.onRender(); break;
 		default: return DefWindowProc(hWnd, message, wParam, lParam);
 		}
@@ -249,17 +346,82 @@ namespace MainWindowDetails
 			{
 				isResizing = true;
 				//printf("CN Resize %i %i\n", re.width, re.height);
-				relay.onResize(re.width, re.height, true);
+				relay.resize(re.width, re.height, true);
 			}
 			break;
 		}
 		//CM handled outside.
-		case Expose:        /*printf("Expose\n");*/ relay.onRender(); /*XFlush(display);*/ break;
+		case Expose:
+		{
+			//printf("Expose\n");
+			//server generated exposes lost window content, the frame is drawn by the loop once the queue is drained:
+			if(!e.xexpose.send_event){ relay.onExpose(rect2i{e.xexpose.x, e.xexpose.y, e.xexpose.width, e.xexpose.height}); }
+			break;
+		}
+		default: relay.onOtherEvent(e); break;
 		}
 	}
 #endif
 }
 
+//Decides when the next frame is due: frames are paced to the target rate, nothing is scheduled
+//while idle, and during interactive resize the interval follows the measured frame cost.
+struct FrameScheduler
+{
+	using clock = std::chrono::steady_clock;
+
+	double targetFps    = 60.0;  //0 means unlimited
+	double resizeFactor = 2.0;   //during resize leave this multiple of the frame cost between frames
+	double resizeSettle = 300.0; //ms without a resize event after which the resize is over
+	bool   animating    = false; //schedule frames even without requests
+	bool   asyncFrames  = false; //frames finish on another thread, their cost is reported with rendered()
+
+	bool   dirty = false, resizing = false;
+	double frameCost = 0.0, resizeCost = 0.0; //smoothed durations in ms
+	clock::time_point last, lastResize;
+
+	static double ms(clock::duration d){ return std::chrono::duration<double, std::milli>(d).count(); }
+	static void smooth(double& avg, double x){ avg = avg == 0.0 ? x : 0.8 * avg + 0.2 * x; }
+
+	void request(){ dirty = true; }
+	void resized(clock::time_point t, double cost){ resizing = true; lastResize = t; dirty = true; smooth(resizeCost, cost); }
+
+	double interval() const
+	{
+		double base = targetFps > 0.0 ? 1000.0 / targetFps : 0.0;
+		return resizing ? std::max(base, resizeFactor * (frameCost + resizeCost)) : base;
+	}
+
+	//ends the resize phase when it settled, then a full frame is requested:
+	void update(clock::time_point now)
+	{
+		if(resizing && ms(now - lastResize) > resizeSettle){ resizing = false; dirty = true; }
+	}
+
+	//the time of the next frame, or of the next state change, clock::time_point::max() when idle:
+	clock::time_point deadline() const
+	{
+		auto t = clock::time_point::max();
+		if(dirty || animating){ t = last + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(interval())); }
+		if(resizing){ t = std::min(t, lastResize + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(resizeSettle))); }
+		return t;
+	}
+
+	bool due(clock::time_point now) const { return (dirty || animating) && now >= deadline(); }
+
+	//keeps the cadence of the target rate unless a frame was missed by more than an interval:
+	void presented(clock::time_point start, clock::time_point end)
+	{
+		auto step = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(interval()));
+		last = (start - last) < 2 * step ? last + step : start;
+		dirty = false;
+		if(!asyncFrames){ smooth(frameCost, ms(end - start)); }
+	}
+
+	//the cost of a frame drawn asynchronously, in ms:
+	void rendered(double cost){ smooth(frameCost, cost); }
+};
+
 struct PlatformWindowData
 {
 	pos2<int>  pos,  last_pos;
@@ -441,8 +603,23 @@ struct PlatformWindowData
 	unsigned int depth;
 	Window handle;
 	Atom AWM_DELETE_WINDOW, AWM_PROTOCOLS;
-	bool eventDriven, needRedraw, isResizing, isQuit;
-	PlatformWindowData():display{nullptr}, visual{nullptr}, screen{0}, eventDriven{true}, needRedraw{false}, isResizing{false}, isQuit{false}{}
+	bool eventDriven, isResizing, isQuit;
+	FrameScheduler scheduler;
+
+	//The loop sleeps in poll() on the connection, a timerfd armed to the next deadline and an eventfd for wakeups from other threads.
+	struct Timer
+	{
+		int id;
+		FrameScheduler::clock::time_point due;
+		FrameScheduler::clock::duration   period; //zero for one-shot timers
+		std::function<void(void)> f;
+	};
+	int timerfd, wakefd, lastTimerId;
+	std::vector<Timer> timers;
+	std::mutex postedMutex;
+	std::vector<std::function<void(void)>> posted;
+
+	PlatformWindowData():display{nullptr}, visual{nullptr}, screen{0}, eventDriven{true}, isResizing{false}, isQuit{false}, timerfd{-1}, wakefd{-1}, lastTimerId{0}{}
 
 	bool rename(utf8string const& name)
 	{
@@ -468,6 +645,9 @@ struct PlatformWindowData
 
 		display = XOpenDisplay(0);
 		if(!display){ printf("Cannot open display\n"); return false; }
+		timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		wakefd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if(timerfd < 0 || wakefd < 0){ printf("Cannot create timerfd or eventfd\n"); return false; }
 		screen = DefaultScreen(display);
 		visual = DefaultVisual(display, screen);
 		depth = DefaultDepth(display, screen);
@@ -576,110 +756,156 @@ struct PlatformWindowData
 		return true;
 	}
 
-	template<typename F>
-	void loop(F&& step)
+	//Timers run on the event thread, a repeating timer keeps its cadence unless it fell behind by a whole period:
+	int setTimer(double ms, std::function<void(void)> f, bool repeat = false)
+	{
+		auto d = std::chrono::duration_cast<FrameScheduler::clock::duration>(std::chrono::duration<double, std::milli>(ms));
+		timers.push_back(Timer{++lastTimerId, FrameScheduler::clock::now() + d, repeat ? d : FrameScheduler::clock::duration::zero(), std::move(f)});
+		return lastTimerId;
+	}
+	void cancelTimer(int id){ timers.erase(std::remove_if(timers.begin(), timers.end(), [id](Timer const& t){ return t.id == id; }), timers.end()); }
+
+	//May be called from any thread, f runs on the event thread before the next frame:
+	void post(std::function<void(void)> f)
+	{
+		{
+			std::lock_guard<std::mutex> lock(postedMutex);
+			posted.push_back(std::move(f));
+		}
+		wake();
+	}
+	void redrawAsync(){ post([this]{ redraw(); }); }
+	void wake() const { uint64_t one = 1; if(wakefd >= 0){ (void)!write(wakefd, &one, sizeof(one)); } }
+
+	void run_posted()
 	{
-		auto t0 = std::chrono::high_resolution_clock::now();
-		auto t1 = t0, trsz = t0;
-		//printf("Entering event loop\n");
-		long nredraw = 0, nredrawproc = 0;
+		std::vector<std::function<void(void)>> fs;
+		{
+			std::lock_guard<std::mutex> lock(postedMutex);
+			fs.swap(posted);
+		}
+		for(auto& f : fs){ f(); }
+	}
 
-		auto sendExposeEvent = [&]()
+	void run_timers(FrameScheduler::clock::time_point now)
+	{
+		std::vector<int> due;
+		for(auto const& t : timers){ if(t.due <= now){ due.push_back(t.id); } }
+		//callbacks may set or cancel timers:
+		for(int id : due)
+		{
+			auto it = std::find_if(timers.begin(), timers.end(), [id](Timer const& t){ return t.id == id; });
+			if(it == timers.end()){ continue; }
+			auto f = it->f;
+			if(it->period == FrameScheduler::clock::duration::zero()){ timers.erase(it); }
+			else{ it->due = (now - it->due) < it->period ? it->due + it->period : now + it->period; }
+			f();
+		}
+	}
+
+	FrameScheduler::clock::time_point next_timer() const
+	{
+		auto t = FrameScheduler::clock::time_point::max();
+		for(auto const& x : timers){ t = std::min(t, x.due); }
+		return t;
+	}
+
+	//sleeps until an event arrives, the deadline passes, or another thread wakes the loop:
+	void wait(FrameScheduler::clock::time_point deadline)
+	{
+		if(XPending(display) > 0){ return; }
+		itimerspec its{};
+		if(deadline != FrameScheduler::clock::time_point::max())
+		{
+			if(deadline <= FrameScheduler::clock::now()){ return; }
+			//steady_clock counts CLOCK_MONOTONIC, a zero value would disarm the timer:
+			auto ns = std::max<long long>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count());
+			its.it_value.tv_sec = ns / 1000000000; its.it_value.tv_nsec = ns % 1000000000;
+		}
+		timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &its, nullptr);
+
+		pollfd fds[3] = {{ConnectionNumber(display), POLLIN, 0}, {timerfd, POLLIN, 0}, {wakefd, POLLIN, 0}};
+		poll(fds, 3, -1);
+		uint64_t n;
+		if(fds[1].revents & POLLIN){ (void)!read(timerfd, &n, sizeof(n)); }
+		if(fds[2].revents & POLLIN){ (void)!read(wakefd,  &n, sizeof(n)); }
+	}
+
+	//Merges a run of motion events into the last one, the skipped positions go to relay.motionHistory.
+	//Of the configure events queued only the latest matters:
+	void coalesce(XEvent& e)
+	{
+		XEvent n;
+		if(e.type == MotionNotify)
+		{
+			auto& history = MainWindowDetails::relay.motionHistory;
+			history.clear();
+			while(XPending(display) > 0)
+			{
+				XPeekEvent(display, &n);
+				if(n.type != MotionNotify || n.xmotion.window != e.xmotion.window){ break; }
+				history.push_back(pos2<int>{e.xmotion.x, e.xmotion.y});
+				XNextEvent(display, &e);
+			}
+		}
+		else if(e.type == ConfigureNotify)
 		{
-			XExposeEvent xee{0};
-			xee.type = Expose;
-			xee.send_event = True;
-			xee.display = display;
-			xee.window = handle;
-			XSendEvent(display, handle, False, NoEventMask, (XEvent*)&xee);
-		};
+			while(XCheckTypedWindowEvent(display, handle, ConfigureNotify, &n)){ e = n; }
+		}
+	}
 
+	//Events are handled as they arrive, coalesced where possible, and the whole queue is drained before a frame is drawn.
+	//Frames are drawn when the scheduler says so: event driven windows after input or redraw(),
+	//the others call step and draw continuously at the target rate.
+	template<typename F>
+	void loop(F&& step)
+	{
+		using clock = FrameScheduler::clock;
 		//Reposition the window, because some WMs move the window initially despite the x, y, set in create window.
 		XMoveResizeWindow(display, handle, last_pos.x, last_pos.y, last_size.w, last_size.h);
-		while(true)
+		scheduler.last = clock::now();
+		scheduler.request();
+		while(!isQuit)
 		{
-			XEvent e;
-			if(eventDriven)
+			scheduler.animating = !eventDriven;
+			while(!isQuit && XPending(display) > 0)
 			{
+				XEvent e;
 				XNextEvent(display, &e);
 				if(XFilterEvent(&e, handle)){ continue; }
-				if(e.type == ClientMessage && e.xclient.message_type == AWM_PROTOCOLS && e.xclient.data.l[0] == AWM_DELETE_WINDOW){ isQuit = true; MainWindowDetails::relay.onExit(); break; }
-				else{ MainWindowDetails::Proc(display, handle, ic, e, size, isResizing); }
-				//step();
-				//printf("while 1\n");
-				needRedraw = true;
-			}
-			else
-			{
-				auto res = True;
-				//while(res == True && !isQuit)
+				if(e.type == ClientMessage)
 				{
-					while(XEventsQueued(display, QueuedAlready) > 0)
-					{
-						XNextEvent(display, &e);
-						if(XFilterEvent(&e, handle)){ continue; }
-						if(e.type == ClientMessage)
-						{
-							if(e.xclient.send_event){ /*printf("[%zi] Sent CM ", e.xclient.serial);*/ }
-							else{ printf("[%zi] Not sent CM ", e.xclient.serial); }
-
-							if(e.xclient.message_type == AWM_PROTOCOLS)
-							{
-								printf("WM_PROTOCOLS ");
-								if(e.xclient.data.l[0] == AWM_DELETE_WINDOW){ printf("AWM_DELETE_WINDOW\n"); isQuit = true; MainWindowDetails::relay.onExit(); break; }
-								else{ printf("Unknown protocol message %zi\n", e.xclient.data.l[0]); }
-							}
-							else if(e.xclient.message_type == 424242){ nredrawproc = e.xclient.data.l[0]; /*printf("Redraw processed: %zi\n", nredrawproc);*/ }
-							else{ printf("Other Atom %zi ", e.xclient.message_type); }
-						}
-						else
-						{
-							bool wasResize = false;
-							MainWindowDetails::Proc(display, handle, ic, e, size, wasResize);
-							if(wasResize){ isResizing = true; trsz = std::chrono::high_resolution_clock::now(); }
-						}
-					}
-					needRedraw = true;
+					if(e.xclient.message_type == AWM_PROTOCOLS && (Atom)e.xclient.data.l[0] == AWM_DELETE_WINDOW){ isQuit = true; MainWindowDetails::relay.exit(); }
+					continue;
 				}
+				coalesce(e);
+				if(e.type == Expose){ scheduler.request(); }
+				bool wasResize = false;
+				auto t0 = clock::now();
+				MainWindowDetails::Proc(display, handle, ic, e, size, wasResize);
+				auto t1 = clock::now();
+				if(wasResize){ scheduler.resized(t1, FrameScheduler::ms(t1 - t0)); }
+				//extension events, like XShm completions, do not ask for a frame:
+				else if(eventDriven && e.type < LASTEvent){ scheduler.request(); }
 			}
+			if(isQuit){ break; }
 
-			if(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now()-trsz).count()/1000.0 > 300.0)
-			{
-				//printf("isResizing = false\n");
-				isResizing = false;
-				needRedraw = true;
-			}
+			run_posted();
+			run_timers(clock::now());
+			if(isQuit){ break; }
 
-			if(needRedraw)
+			auto now = clock::now();
+			scheduler.update(now);
+			isResizing = scheduler.resizing;
+			if(scheduler.due(now))
 			{
-				double limit = (isResizing) ? 250.0 : 100.0;
-				t1 = std::chrono::high_resolution_clock::now();
-				auto dt = std::chrono::duration_cast<std::chrono::microseconds>(t1-t0).count()/1000.0;
-				if(dt > limit)
-				{
-					if(eventDriven){ /*printf("limited redraw, expose event, dt = %f\n", dt);*/ sendExposeEvent();/*XClearArea(display, handle, 0, 0, 1, 1, true);*/ }
-					else if(!eventDriven && (nredraw == nredrawproc))
-					{
-						step();
-						sendExposeEvent();//XClearArea(display, handle, 0, 0, 1, 1, true);
-						nredraw += 1;
-						XEvent ev{0};
-						ev.type = ClientMessage;
-						ev.xclient.format = 32;
-						ev.xclient.window = handle;
-						ev.xclient.message_type = 424242;
-						ev.xclient.data.l[0] = nredraw;
-						XSendEvent(display, handle, False, NoEventMask, &ev);
-						XSync(display, False);
-						//XFlush(display);
-					}
-					t0 = t1;
-					needRedraw = false;
-				}
+				if(!eventDriven){ step(); }
+				auto t0 = clock::now();
+				MainWindowDetails::relay.onRender();
+				scheduler.presented(t0, clock::now());
+				continue;
 			}
-			//
-			//
-			if(isQuit){ break; }
+			wait(std::min(scheduler.deadline(), next_timer()));
 		}
 	}
 
@@ -689,7 +915,7 @@ struct PlatformWindowData
 		printf("x= %i, y= %i, w= %i, h= %i\n", pos.x, pos.y, size.w, size.h);
 	}*/
 
-	void redraw() { /*printf("Redraw req\n");*/ needRedraw = true; /*XClearArea(display, handle, 0, 0, size.w, size.h, true);*/ /*XSync(display, False);*/ }
+	void redraw() { scheduler.request(); }
 	void show() const { printf("show\n"); XMapRaised(display, handle); }
 	void hide() const { XUnmapWindow(display, handle); }
 	void minimize() { last_pos = pos; last_size = size; XIconifyWindow(display, handle, 0); }
@@ -800,7 +1026,14 @@ struct PlatformWindowData
 		XSendEvent(display, handle, False, NoEventMask, &e);
 		XSync(display, False);
 	}
-	bool close(){ XDestroyWindow(display, handle); XCloseDisplay(display); eventDriven = true; return true; }
+	bool close()
+	{
+		XDestroyWindow(display, handle); XCloseDisplay(display); eventDriven = true;
+		if(timerfd >= 0){ ::close(timerfd); timerfd = -1; }
+		if(wakefd  >= 0){ ::close(wakefd);  wakefd  = -1; }
+		timers.clear();
+		return true;
+	}
 
 	void fullscreen()
 	{
@@ -866,33 +1099,201 @@ struct PlatformWindowData
 #endif
 };
 
+//Edge functions of a triangle with its vertices snapped to 1/16 pixel, evaluated at pixel centers:
+//pixel (x, y) is inside if a[k]*x + b[k]*y + c[k] >= 0 for all three edges. The top-left rule is folded into c.
+struct TriangleEdges
+{
+	static constexpr int subpixel = 16;
+	static constexpr double max_coord = 1 << 22; //triangles with vertices farther away are not drawn
+
+	int32_t   v[6];        //snapped vertices as x0, y0, x1, y1, x2, y2
+	long long a[3], b[3], c[3];
+	rect2i    bounds;      //pixels whose center may be inside, empty for degenerate triangles
+	bool      narrow;      //the edge values over a 16 pixel neighbourhood fit in 32 bits
+
+	long long eval(int k, int x, int y) const { return a[k] * x + b[k] * y + c[k]; }
+
+	static TriangleEdges make(double x0, double y0, double x1, double y1, double x2, double y2)
+	{
+		int32_t v[6];
+		double p[6] = {x0, y0, x1, y1, x2, y2};
+		for(int i=0; i<6; ++i)
+		{
+			if(!(std::abs(p[i]) <= max_coord)){ TriangleEdges te{}; te.bounds = {0, 0, 0, 0}; return te; }
+			v[i] = (int32_t)std::lround(p[i] * subpixel);
+		}
+		return from_fixed(v);
+	}
+
+	static TriangleEdges from_fixed(int32_t const* vs)
+	{
+		TriangleEdges te{};
+		memcpy(te.v, vs, sizeof(te.v));
+		te.bounds = {0, 0, 0, 0};
+		long long X[3] = {vs[0], vs[2], vs[4]}, Y[3] = {vs[1], vs[3], vs[5]};
+		const long long area = (X[1] - X[0]) * (Y[2] - Y[0]) - (Y[1] - Y[0]) * (X[2] - X[0]);
+		if(area == 0){ return te; }
+		if(area < 0){ std::swap(X[1], X[2]); std::swap(Y[1], Y[2]); }
+
+		const long long h = subpixel / 2;
+		te.narrow = true;
+		for(int k=0; k<3; ++k)
+		{
+			const int i = k, j = (k + 1) % 3;
+			te.a[k] = -(Y[j] - Y[i]) * subpixel;
+			te.b[k] =  (X[j] - X[i]) * subpixel;
+			te.c[k] =  (X[j] - X[i]) * (h - Y[i]) - (Y[j] - Y[i]) * (h - X[i]);
+			//pixels exactly on a right or bottom edge belong to the neighbour:
+			if(!(te.a[k] > 0 || (te.a[k] == 0 && te.b[k] > 0))){ te.c[k] -= 1; }
+			te.narrow = te.narrow && 16 * (std::abs(te.a[k]) + std::abs(te.b[k])) < (1LL << 30);
+		}
+
+		auto floordiv = [](long long n, long long d){ return n >= 0 ? n / d : -((-n + d - 1) / d); };
+		const long long xmin = floordiv(std::min({X[0], X[1], X[2]}) - h + subpixel - 1, subpixel);
+		const long long ymin = floordiv(std::min({Y[0], Y[1], Y[2]}) - h + subpixel - 1, subpixel);
+		const long long xmax = floordiv(std::max({X[0], X[1], X[2]}) - h, subpixel);
+		const long long ymax = floordiv(std::max({Y[0], Y[1], Y[2]}) - h, subpixel);
+		te.bounds = rect2i{(int)xmin, (int)ymin, (int)(xmax - xmin + 1), (int)(ymax - ymin + 1)};
+		return te;
+	}
+};
+
+//Tiled mode: with more than one thread (setThreads) the primitives taking a Color8 are not rasterized immediately,
+//but recorded and binned into tile_size x tile_size screen tiles, which are rasterized in parallel on flush().
+//Each tile replays its commands in order, so the result is identical to the serial path.
+//Calls taking a callable and pixel reads flush the pending commands and run immediately.
+//
+//Recording mode (setRecording): the commands of each frame (between beginFrame and endFrame) are kept,
+//and a frame with the same commands as the previous one is not rasterized again.
+//A frame that contains a call taking a callable cannot be compared and is always rasterized.
+//Frames are assumed to redraw everything they show, e.g. starting with clear().
+//
+//Damage: the union of the pixels touched since clearDamage() is tracked as a region. In recording mode only
+//the commands differing from the previous frame are damaged, and only the damaged rects are rasterized again.
+//
+//Clipping: pushClip narrows the drawable area to the intersection with the current clip rect, popClip restores it.
+//Every primitive, including the ones taking a callable, touches only pixels inside the clip. Recorded commands
+//keep their clipped bounds, so the clip takes part in the frame comparison.
 struct SoftwareRenderer
 {
+	static constexpr int tile_size = 64;
+
 	Image2<Color8> backbuffer;
+	int            nthreads;
+	bool           recording, frameDirty, previousValid;
+	DrawList       pending, previous;
+	region2i       damage;
+	std::vector<rect2i> clips;
+	std::vector<std::vector<unsigned int>> bins;
+	std::unique_ptr<WorkerPool> pool;
+
+	SoftwareRenderer():nthreads{1}, recording{false}, frameDirty{false}, previousValid{false}{}
+
+	void init  (int w, int h){ backbuffer.resize({w, h}); damageAll(); }
+	void resize(int w, int h){ /*printf("Renderer resize %i %i\n", w, h);*/ flush(); backbuffer.resize({w, h}); previousValid = false; damage.clear(); damageAll(); }
+	void close(){ flush(); pool.reset(); }
+
+	//moves the backbuffer pixels to memory from arena (nullptr for the heap), the content is lost:
+	void setPixelArena(PixelArena* arena, size_t capacity = 0)
+	{
+		barrier();
+		auto sz = backbuffer.size();
+		backbuffer.data = decltype(backbuffer.data)(PixelAllocator<Color8>{arena});
+		backbuffer.data.reserve(std::max(capacity, (size_t)sz.area()));
+		backbuffer.resize(sz);
+		previousValid = false;
+		damageAll();
+	}
+
+	//room for a backbuffer of up to cap pixels, so resizing within it does not allocate:
+	void reserve(size2<int> cap){ barrier(); backbuffer.reserve((size_t)cap.area()); }
+
+	void setThreads(int n)
+	{
+		barrier();
+		nthreads = std::max(n, 1);
+		if(nthreads > 1){ pool = std::make_unique<WorkerPool>(nthreads - 1); }
+		else            { pool.reset(); }
+	}
+	int  threads()    const { return nthreads; }
+	bool isDeferred() const { return nthreads > 1 || recording; }
+
+	void setRecording(bool b){ flush(); recording = b; previous.clear(); previousValid = false; }
+	bool isRecording() const { return recording; }
+
+	//the commands of the last finished frame in recording mode:
+	DrawList const& lastFrame() const { return previous; }
 
-	void init  (int w, int h){ backbuffer.resize({w, h}); }
-	void resize(int w, int h){ /*printf("Renderer resize %i %i\n", w, h);*/ backbuffer.resize({w, h}); }
-	void close(){}
+	void beginFrame(){ frameDirty = false; clips.clear(); }
+
+	//Rasterizes the frame, returns false if it was skipped because it is identical to the previous one.
+	bool endFrame()
+	{
+		if(!recording){ flush(); frameDirty = false; return true; }
+		bool same = false;
+		if(previousValid && !frameDirty)
+		{
+			same = pending.same_as(previous);
+			if(!same)
+			{
+				auto d = difference(pending, previous);
+				same = d.empty();
+				for(auto const& r : d.rects){ rasterize(pending, intersect(r, backbuffer.rect())); }
+				damage.add(d);
+			}
+		}
+		else{ replay(pending); }
+		std::swap(previous, pending);
+		pending.clear();
+		previousValid = !frameDirty;
+		frameDirty = false;
+		return !same;
+	}
+
+	region2i const& getDamage() const { return damage; }
+	void clearDamage(){ damage.clear(); }
+	void addDamage(rect2i r){ damage.add(intersect(r, backbuffer.rect())); }
+	void damageAll(){ addDamage(backbuffer.rect()); }
+
+	//the area primitives may draw to, always inside the backbuffer:
+	rect2i clipRect() const { return clips.empty() ? backbuffer.rect() : intersect(clips.back(), backbuffer.rect()); }
+	void pushClip(rect2i r){ clips.push_back(intersect(r, clipRect())); }
+	void popClip(){ if(!clips.empty()){ clips.pop_back(); } }
+	bool isVisible(rect2i r) const { return overlaps(r, clipRect()); }
+
+	//clears the current clip rect:
+	void clear(Color8 col)
+	{
+		if(!clips.empty()){ filledrect(clipRect(), col); }
+		else if(isDeferred()){ pending.clear(); filledrect(backbuffer.rect(), col); }
+		else{ PixelKernels::fill_span(backbuffer.data.data(), backbuffer.size().area(), col); damageAll(); }
+	}
 
 	void setpixel(int x, int y, Color8 c)
 	{
-		if(clamp(x, 0, backbuffer.w()-1) == x && clamp(y, 0, backbuffer.h()-1) == y){ backbuffer(x, y) = c; }
+		if(isDeferred()){ filledrect(x, y, 1, 1, c); return; }
+		if(is_inside_half_open(clipRect(), x, y)){ backbuffer(x, y) = c; touch({x, y, 1, 1}); }
 	}
 
 	Color8 getpixel(int x, int y)
 	{
+		barrier();
 		if(clamp(x, 0, backbuffer.w()-1) == x && clamp(y, 0, backbuffer.h()-1) == y){ return backbuffer(x, y); }
 		else{ return Color8{0, 0, 0, 0}; }
 	}
 
+	//calls f(x, y, color) for every pixel inside the clip rect:
 	template<typename F>
 	void forall_pixels(F&& f)
 	{
+		barrier();
+		const auto c = clipRect();
+		touch(c);
 		const int w = backbuffer.w();
-		for(int y=0; y<backbuffer.h(); ++y)
+		for(int y=c.y; y<bottom(c); ++y)
 		{
-			int i = y * w;
-			for(int x=0; x<w; ++x, ++i)
+			int i = y * w + c.x;
+			for(int x=c.x; x<right(c); ++x, ++i)
 			{
 				backbuffer.data[i] = f(x, y, backbuffer.data[i]);
 			}
@@ -929,7 +1330,7 @@ struct SoftwareRenderer
 			if(is_finite(yl) && is_finite(yc))
 			{
 				auto iyc = y + h - (yc - ymin) / (ymax - ymin) * h;
-				line(x+i-1, (int)iyl, x+i, (int)iyc, [&](auto){ return col; });
+				line(x+i-1, (int)iyl, x+i, (int)iyc, col);
 				iyl = iyc;
 				yl = yc;
 			}
@@ -982,17 +1383,15 @@ struct SoftwareRenderer
 	void plot_by_index(int x, int y, int w, int h, F&& f)
 	{
 		if(w <= 0 || h <= 0){ return; }
-		auto ymin = clamp(y,   0, backbuffer.h()-1);
-		auto ymax = clamp(y+h, 0, backbuffer.h()-1);
-		auto xmin = clamp(x,   0, backbuffer.w()-1);
-		auto xmax = clamp(x+w, 0, backbuffer.w()-1);
-		for(int j=ymin; j<ymax; ++j)
-		{
-			if(j - ymin >= h){ break; }
-			int k = j * backbuffer.w() + xmin;
-			for(int i=xmin; i<xmax; ++i, ++k)
+		barrier();
+		auto c = intersect(rect2i{x, y, w, h}, clipRect());
+		if(c.w <= 0 || c.h <= 0){ return; }
+		touch(c);
+		for(int j=c.y; j<bottom(c); ++j)
+		{
+			int k = j * backbuffer.w() + c.x;
+			for(int i=c.x; i<right(c); ++i, ++k)
 			{
-				if(i - xmin >= w){ break; }
 				backbuffer.data[k] = f(i-x , j-y, backbuffer.data[k]);
 			}
 		}
@@ -1000,31 +1399,25 @@ struct SoftwareRenderer
 	template<typename T, typename F>
 	void plot_by_index(rect2<T> r, F&& f){ plot_by_index(r.x, r.y, r.w, r.h, std::forward<F>(f)); }
 
+	//the border covers [x, x+w] x [y, y+h], drawn as four spans:
 	void rect(int x, int y, int w, int h, Color8 col)
 	{
 		if(w <= 0 || h <= 0){ return; }
-		line(x,   y,   x+w, y,   [&](auto){ return col; });
-		line(x+w, y,   x+w, y+h, [&](auto){ return col; });
-		line(x+w, y+h, x,   y+h, [&](auto){ return col; });
-		line(x,   y+h, x,   y,   [&](auto){ return col; });
+		hline(x,   x+w, y,   col);
+		hline(x,   x+w, y+h, col);
+		if(h < 2){ return; }
+		vline(x,   y+1, y+h-1, col);
+		vline(x+w, y+1, y+h-1, col);
 	}
 	void rect(rect2<int> r, Color8 col){ rect(r.x, r.y, r.w, r.h, col); }
 
+	//fills [x, x+w) x [y, y+h) clipped to the clip rect:
 	void filledrect(int x, int y, int w, int h, Color8 col)
 	{
 		if(w <= 0 || h <= 0){ return; }
-		auto ymin = clamp(y,   0, backbuffer.h()-1);
-		auto ymax = clamp(y+h, 0, backbuffer.h()-1);
-		auto xmin = clamp(x,   0, backbuffer.w()-1);
-		auto xmax = clamp(x+w, 0, backbuffer.w()-1);
-		for(int j=ymin; j<=ymax; ++j)
-		{
-			int k = j * backbuffer.w() + xmin;
-			for(int i=xmin; i<=xmax; ++i, ++k)
-			{
-				backbuffer.data[k] = col;
-			}
-		}
+		if(isDeferred()){ record(DrawOp::FilledRect, col, x, y, w, h, rect2i{x, y, w, h}); return; }
+		fill_clipped(rect2i{x, y, w, h}, col, clipRect());
+		touch({x, y, w, h});
 	}
 	void filledrect(rect2<int> r, Color8 col){ filledrect(r.x, r.y, r.w, r.h, col); }
 
@@ -1043,59 +1436,215 @@ struct SoftwareRenderer
 	template<typename F>
 	void line(int x0, int y0, int x1, int y1, F&& f)
 	{
-		int dx = abs(x1-x0);
-		int sx = x0 < x1 ? 1 : -1;
-		int dy = -abs(y1-y0);
-		int sy = y0 < y1 ? 1 : -1;
-		int err = dx + dy;
-		int e2 = 0;
-		for (;;){
-			setpixel(x0, y0, f(getpixel(x0, y0)));
-			e2 = 2*err;
-			if (e2 >= dy) {
-				if (x0 == x1) break;
-				err += dy; x0 += sx;
-			}
-			if (e2 <= dx) {
-				if (y0 == y1) break;
-				err += dx; y0 += sy;
-			}
+		barrier();
+		touch(span_bounds(x0, y0, x1, y1));
+		line_clipped(x0, y0, x1, y1, clipRect(), std::forward<F>(f));
+	}
+
+	//Bresenham line with inclusive endpoints. The major axis advances every step and after n steps the minor axis
+	//has advanced (2*m*n + M) / (2*M), where M and m are the major and minor extents. So the range of steps inside
+	//clip is computed up front (clipping in step space gives the same pixels as testing each one), and the loop
+	//runs without bounds checks.
+	template<typename F>
+	void line_clipped(int x0, int y0, int x1, int y1, rect2i clip, F&& f)
+	{
+		if(clip.w <= 0 || clip.h <= 0){ return; }
+		const bool xmajor = std::abs(x1-x0) >= std::abs(y1-y0);
+		const long long M = xmajor ? std::abs(x1-x0) : std::abs(y1-y0);
+		const long long m = xmajor ? std::abs(y1-y0) : std::abs(x1-x0);
+		const int p0 = xmajor ? x0 : y0, sp = (xmajor ? x0 < x1 : y0 < y1) ? 1 : -1;
+		const int q0 = xmajor ? y0 : x0, sq = (xmajor ? y0 < y1 : x0 < x1) ? 1 : -1;
+		const int pmin = xmajor ? left(clip) : top(clip),  pmax = (xmajor ? right(clip) : bottom(clip)) - 1;
+		const int qmin = xmajor ? top(clip)  : left(clip), qmax = (xmajor ? bottom(clip) : right(clip)) - 1;
+
+		//steps in [nlo, nhi] keep the major coordinate inside:
+		long long nlo = sp > 0 ? (long long)pmin - p0 : (long long)p0 - pmax;
+		long long nhi = sp > 0 ? (long long)pmax - p0 : (long long)p0 - pmin;
+		nlo = std::max(nlo, 0LL); nhi = std::min(nhi, M);
+
+		//minor advances in [klo, khi] keep the minor coordinate inside:
+		long long klo = sq > 0 ? (long long)qmin - q0 : (long long)q0 - qmax;
+		long long khi = sq > 0 ? (long long)qmax - q0 : (long long)q0 - qmin;
+		klo = std::max(klo, 0LL);
+		if(klo > khi){ return; }
+		if(m == 0){ if(klo > 0){ return; } }
+		else
+		{
+			if(klo > 0){ nlo = std::max(nlo, (2*M*klo - M + 2*m - 1) / (2*m)); }
+			nhi = std::min(nhi, (2*M*khi + M + 2*m - 1) / (2*m) - 1);
+		}
+		if(nlo > nhi){ return; }
+
+		const long long t = 2*m*nlo + M;
+		long long r = M > 0 ? t % (2*M) : 0;
+		const long long q = M > 0 ? t / (2*M) : 0;
+		const int w = backbuffer.w();
+		const ptrdiff_t dmaj = xmajor ? sp : (ptrdiff_t)sp * w;
+		const ptrdiff_t dmin = xmajor ? (ptrdiff_t)sq * w : sq;
+		const long long p = p0 + sp * nlo, qq = q0 + sq * q;
+		ptrdiff_t i = xmajor ? (ptrdiff_t)qq * w + p : (ptrdiff_t)p * w + qq;
+		Color8* data = backbuffer.data.data();
+		for(long long n = nlo; n <= nhi; ++n)
+		{
+			data[i] = f(data[i]);
+			i += dmaj;
+			r += 2*m;
+			if(r >= 2*M){ r -= 2*M; i += dmin; }
 		}
 	}
 
 	template<typename I, typename F>
 	void hline(int x0, int x1, int y, I&& i, F&& f)
 	{
-		if(y < 0 || y >= backbuffer.h()){ return; }
-		x0 = std::max(0, x0); x0 = std::min(x0, backbuffer.w()-1);
-		x1 = std::max(0, x1); x1 = std::min(x1, backbuffer.w()-1);
+		barrier();
+		touch(span_bounds(x0, y, x1, y));
+		const auto c = clipRect();
+		if(y < c.y || y >= bottom(c) || c.w <= 0){ return; }
+		x0 = std::max(c.x, x0); x0 = std::min(x0, right(c)-1);
+		x1 = std::max(c.x, x1); x1 = std::min(x1, right(c)-1);
 		for(int x = std::min(x0, x1); x<=std::max(x0, x1); ++x){ if(i(x, y)){ backbuffer(x, y) = f(backbuffer(x, y)); } }
 	}
 
 	template<typename I, typename F>
 	void vline(int x, int y0, int y1, I&& i, F&& f)
 	{
-		if(x < 0 || x >= backbuffer.w()){ return; }
-		y0 = std::max(0, y0); y0 = std::min(y0, backbuffer.h()-1);
-		y1 = std::max(0, y1); y1 = std::min(y1, backbuffer.h()-1);
+		barrier();
+		touch(span_bounds(x, y0, x, y1));
+		const auto c = clipRect();
+		if(x < c.x || x >= right(c) || c.h <= 0){ return; }
+		y0 = std::max(c.y, y0); y0 = std::min(y0, bottom(c)-1);
+		y1 = std::max(c.y, y1); y1 = std::min(y1, bottom(c)-1);
 		for(int y = std::min(y0, y1); y<=std::max(y0, y1); ++y){ if(i(x, y)){ backbuffer(x, y) = f(backbuffer(x, y)); } }
 	}
 
-	void line (int x0, int y0, int x1, int y1, Color8 c){ line(x0, y0, x1, y1, [=](auto){ return c; }); } 
-	void hline(int x0, int x1, int y,  Color8 c){ hline(x0, x1, y, [](auto, auto){ return true; }, [=](auto){ return c; }); } 
-	void vline(int x,  int y0, int y1, Color8 c){ vline(x, y0, y1, [](auto, auto){ return true; }, [=](auto){ return c; }); } 
+	void line(int x0, int y0, int x1, int y1, Color8 c)
+	{
+		if(y0 == y1){ hline(x0, x1, y0, c); return; }
+		if(x0 == x1){ vline(x0, y0, y1, c); return; }
+		if(isDeferred()){ record(DrawOp::Line, c, x0, y0, x1, y1, span_bounds(x0, y0, x1, y1)); return; }
+		line_clipped(x0, y0, x1, y1, clipRect(), [=](auto){ return c; });
+		touch(span_bounds(x0, y0, x1, y1));
+	}
 
-	void blend_grayscale_image(Image2<unsigned char> const& img, pos2i p, Color8 fg){ blend_grayscale_image(img, p.x, p.y, fg); }
-	void blend_grayscale_image(Image2<unsigned char> const& img, int x, int y, Color8 fg)
+	//endpoints are inclusive:
+	void hline(int x0, int x1, int y, Color8 c)
+	{
+		if(isDeferred()){ record(DrawOp::HLine, c, x0, y, x1, y, span_bounds(x0, y, x1, y)); return; }
+		hline_clipped(x0, x1, y, c, clipRect());
+		touch(span_bounds(x0, y, x1, y));
+	}
+
+	void vline(int x, int y0, int y1, Color8 c)
+	{
+		if(isDeferred()){ record(DrawOp::VLine, c, x, y0, x, y1, span_bounds(x, y0, x, y1)); return; }
+		vline_clipped(x, y0, y1, c, clipRect());
+		touch(span_bounds(x, y0, x, y1));
+	}
+
+	void hline_clipped(int x0, int x1, int y, Color8 c, rect2i clip)
 	{
-		rect2i rct; rct = img.rect(); rct = pos2i{x, y};
-		plot_by_index(rct, [&](auto x, auto y, Color8 c0){ return blend8(c0, img(x, y), fg); } );
+		if(y < top(clip) || y >= bottom(clip)){ return; }
+		int xmin = std::max(std::min(x0, x1), left(clip));
+		int xmax = std::min(std::max(x0, x1), right(clip)-1);
+		if(xmin > xmax){ return; }
+		PixelKernels::fill_span(&backbuffer(xmin, y), xmax - xmin + 1, c);
 	}
 
+	void vline_clipped(int x, int y0, int y1, Color8 c, rect2i clip)
+	{
+		if(x < left(clip) || x >= right(clip)){ return; }
+		int ymin = std::max(std::min(y0, y1), top(clip));
+		int ymax = std::min(std::max(y0, y1), bottom(clip)-1);
+		if(ymin > ymax){ return; }
+		const int w = backbuffer.w();
+		Color8* p = &backbuffer(x, ymin);
+		for(int n = ymax - ymin; n >= 0; --n, p += w){ *p = c; }
+	}
+
+	void fill_clipped(rect2i r, Color8 c, rect2i clip)
+	{
+		PixelKernels::fill_rect(backbuffer.data.data(), backbuffer.w(), intersect(r, clip), c);
+	}
+
+	//blends fg with the coverage in img placed at (x, y), clipped to the clip rect:
+	void blend_mask(Image2<unsigned char> const& img, int x, int y, Color8 fg)
+	{
+		auto r = intersect(rect2i{x, y, img.w(), img.h()}, clipRect());
+		if(r.w <= 0 || r.h <= 0){ return; }
+		if(isDeferred())
+		{
+			//only the visible part of the mask is stored:
+			auto at = pending.allocate((size_t)r.w * (size_t)r.h);
+			for(int j=0; j<r.h; ++j){ memcpy(pending.bytes(at) + (size_t)j * r.w, &img(r.x - x, r.y - y + j), (size_t)r.w); }
+			record(DrawOp::BlendMask, fg, r.x, r.y, r.w, r.h, r, at);
+			return;
+		}
+		blend_mask_clipped(&img(r.x - x, r.y - y), img.w(), r, fg, r);
+		touch(r);
+	}
+
+	//mask points to the pixel at (r.x, r.y):
+	void blend_mask_clipped(unsigned char const* mask, int mstride, rect2i r, Color8 fg, rect2i clip)
+	{
+		auto rc = intersect(r, clip);
+		if(rc.w <= 0 || rc.h <= 0){ return; }
+		mask += (size_t)(rc.y - r.y) * (size_t)mstride + (size_t)(rc.x - r.x);
+		PixelKernels::blend_mask(&backbuffer(rc.x, rc.y), backbuffer.w(), mask, mstride, rc.w, rc.h, fg);
+	}
+
+	void blend_grayscale_image(Image2<unsigned char> const& img, pos2i p, Color8 fg){ blend_grayscale_image(img, p.x, p.y, fg); }
+	void blend_grayscale_image(Image2<unsigned char> const& img, int x, int y, Color8 fg){ blend_mask(img, x, y, fg); }
+
 	void copy_image(Image2<Color8> const& img, int x, int y)
 	{
-		rect2i rct; rct = img.rect(); rct = pos2i{x, y};
-		plot_by_index(rct, [&](auto x, auto y, Color8){ return img(x, y); } );
+		auto r = intersect(rect2i{x, y, img.w(), img.h()}, clipRect());
+		if(r.w <= 0 || r.h <= 0){ return; }
+		if(isDeferred())
+		{
+			auto at = pending.allocate((size_t)r.w * (size_t)r.h * sizeof(Color8));
+			auto dst = (Color8*)pending.bytes(at);
+			PixelKernels::copy_rect(dst, r.w, &img(r.x - x, r.y - y), img.w(), r.w, r.h);
+			record(DrawOp::CopyImage, Color8{}, r.x, r.y, r.w, r.h, r, at);
+			return;
+		}
+		copy_clipped(&img(r.x - x, r.y - y), img.w(), r, r);
+		touch(r);
+	}
+
+	//src points to the pixel at (r.x, r.y):
+	void copy_clipped(Color8 const* src, int sstride, rect2i r, rect2i clip)
+	{
+		auto rc = intersect(r, clip);
+		if(rc.w <= 0 || rc.h <= 0){ return; }
+		src += (size_t)(rc.y - r.y) * (size_t)sstride + (size_t)(rc.x - r.x);
+		PixelKernels::copy_rect(&backbuffer(rc.x, rc.y), backbuffer.w(), src, sstride, rc.w, rc.h);
+	}
+
+	//composites a premultiplied image at (x, y) with op, the backbuffer is treated as premultiplied too
+	//(which it is as long as it is opaque):
+	void composite(Image2<Color8> const& img, int x, int y, CompositeOp op = CompositeOp::SrcOver)
+	{
+		if(op == CompositeOp::Copy){ copy_image(img, x, y); return; }
+		auto r = intersect(rect2i{x, y, img.w(), img.h()}, clipRect());
+		if(r.w <= 0 || r.h <= 0){ return; }
+		if(isDeferred())
+		{
+			auto at = pending.allocate((size_t)r.w * (size_t)r.h * sizeof(Color8));
+			PixelKernels::copy_rect((Color8*)pending.bytes(at), r.w, &img(r.x - x, r.y - y), img.w(), r.w, r.h);
+			record(DrawOp::Composite, Color8{}, r.x, r.y, r.w, r.h, r, at, (unsigned char)op);
+			return;
+		}
+		composite_clipped(&img(r.x - x, r.y - y), img.w(), r, op, r);
+		touch(r);
+	}
+
+	//src points to the pixel at (r.x, r.y):
+	void composite_clipped(Color8 const* src, int sstride, rect2i r, CompositeOp op, rect2i clip)
+	{
+		auto rc = intersect(r, clip);
+		if(rc.w <= 0 || rc.h <= 0){ return; }
+		src += (size_t)(rc.y - r.y) * (size_t)sstride + (size_t)(rc.x - r.x);
+		PixelKernels::composite_rect(&backbuffer(rc.x, rc.y), backbuffer.w(), src, sstride, rc.w, rc.h, op);
 	}
 
 	size2<int> prerendered_text(PrerenderedText const& pt, int x, int baseline, Color8 fg, HAlign ha = HAlign::InnerLeft)
@@ -1104,7 +1653,7 @@ struct SoftwareRenderer
 		if     (ha == HAlign::HCenter)    { dx -= pt.text_align_box.w/2; }
 		else if(ha == HAlign::InnerRight ){ dx -= pt.text_align_box.w; } 
 		auto rct = pt.img.rect(); rct = pos2<int>{x + dx, baseline - pt.baseline};
-		plot_by_index(rct, [&](auto x, auto y, Color8 c0){ return blend8(c0, pt.img(x, y), fg); } );
+		blend_mask(pt.img, rct.x, rct.y, fg);
 		return {x + rct.w, baseline + pt.dh};
 	}
 
@@ -1118,223 +1667,343 @@ struct SoftwareRenderer
 		if     (va == VAlign::VCenter    ){ dy -= pt.text_align_box.h/2; dy += rct.h/2; }
 		else if(va == VAlign::InnerBottom){ dy -= pt.text_align_box.h;   dy += rct.h;   }
 
-		auto rct2 = pt.img.rect(); rct2 = pos2<int>{rct.x + dx, rct.y + dy};
-		plot_by_index(rct2, [&](auto x, auto y, Color8 c0){ return blend8(c0, pt.img(x, y), fg); } );
+		blend_mask(pt.img, rct.x + dx, rct.y + dy, fg);
 	}
 
+	//Filled triangle, the vertices may be given in any order. Pixels whose center is inside are drawn,
+	//pixels on a shared edge belong to only one of the triangles (top-left rule), so meshes are drawn without overlap.
+	//f is a Color8 or a callable taking and returning the current pixel.
 	template<typename T, typename F>
 	void triangle(T x0, T y0, T x1, T y1, T x2, T y2, F&& f)
 	{
-		auto isInside = [](auto X0, auto Y0, auto X1, auto Y1, auto X2, auto Y2/*, auto b0, auto b1, auto b2*/)
+		auto te = TriangleEdges::make((double)x0, (double)y0, (double)x1, (double)y1, (double)x2, (double)y2);
+		if(te.bounds.w <= 0 || te.bounds.h <= 0){ return; }
+		if constexpr(std::is_convertible_v<F, Color8>)
 		{
-			auto edgeFunction = [](auto px0, auto py0, auto px1, auto py1, auto px2, auto py2){ return (px2 - px0) * (py1 - py0) - (py2 - py0) * (px1 - px0); };
-			return [=](T x, T y)
-			{
-				const float c = 0.0f;
-				const float d = 0.0f;
-				auto w0 = edgeFunction(X0+d, Y0+d, X1+d, Y1+d, x+c, y+c);//+b0; 
-				auto w1 = edgeFunction(X1+d, Y1+d, X2+d, Y2+d, x+c, y+c);//+b1;
-				auto w2 = edgeFunction(X2+d, Y2+d, X0+d, Y0+d, x+c, y+c);//+b2;
-				if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f) { return true; }
-				else{ return false; }
-			};
-		};
-
-		//Sort vertices in asc order:
-		if( y0 > y1 ){ std::swap(x0, x1); std::swap(y0, y1); }
-		if( y0 > y2 ){ std::swap(x0, x2); std::swap(y0, y2); }
-		if( y1 > y2 ){ std::swap(x1, x2); std::swap(y1, y2); }
-
-		/*if( x2 < x1 ){ std::swap(x1, x2); std::swap(y1, y2); }
-
-		auto xmin = std::min({x0, x1, x2});
-		auto ymin = std::min({y0, y1, y2});
-		auto xmax = std::max({x0, x1, x2});
-		auto ymax = std::max({y0, y1, y2});
-
-		auto iI0 = isInside(x0, y0, x1, y1, x2, y2);
-		for(int x=xmin; x<=xmax; ++x)
-		{
-		for(int y=ymin; y<=ymax; ++y)
-		{
-		if(iI0(x, y)){ backbuffer(x, y) = f(backbuffer(x, y)); }
+			Color8 col = f;
+			if(isDeferred()){ record_triangle(te, col); return; }
+			triangle_clipped(te, clipRect(), col);
 		}
+		else
+		{
+			barrier();
+			triangle_clipped(te, clipRect(), std::forward<F>(f));
 		}
+		touch(te.bounds);
+	}
 
-		return;*/
-
-		auto fillBottomFlatTriangle = [&](T X0, T Y0, T X1, T Y1, T X2, T Y2, auto iI)
+	//n triangles from 3*n vertices, with one color for all or one color per triangle:
+	void triangles(pos2<float> const* vertices, int n, Color8 const* cols)
+	{
+		const auto clip = clipRect();
+		rect2i all{0, 0, 0, 0};
+		for(int i=0; i<n; ++i)
 		{
-			if(X1 > X2){ std::swap(X1, X2); std::swap(Y1, Y2); }
+			auto const* v = vertices + 3*i;
+			auto te = TriangleEdges::make(v[0].x, v[0].y, v[1].x, v[1].y, v[2].x, v[2].y);
+			if(te.bounds.w <= 0 || te.bounds.h <= 0){ continue; }
+			if(isDeferred()){ record_triangle(te, cols[i]); continue; }
+			triangle_clipped(te, clip, cols[i]);
+			all = all.w > 0 ? unite(all, te.bounds) : te.bounds;
+		}
+		touch(all);
+	}
+	void triangles(pos2<float> const* vertices, int n, Color8 col)
+	{
+		std::vector<Color8> cols((size_t)std::max(n, 0), col);
+		triangles(vertices, n, cols.data());
+	}
+	void triangles(std::vector<pos2<float>> const& vertices, Color8 col){ triangles(vertices.data(), (int)vertices.size() / 3, col); }
 
-			auto ylim = (int)std::min(Y1, Y2);
+	void record_triangle(TriangleEdges const& te, Color8 col)
+	{
+		auto at = pending.allocate(sizeof(te.v));
+		memcpy(pending.bytes(at), te.v, sizeof(te.v));
+		record(DrawOp::Triangle, col, 0, 0, 0, 0, te.bounds, at);
+	}
 
-			auto dx1 =  abs(X1-X0); auto sx1 = X0 < X1 ? 1 : -1;
-			auto dy1 = -abs(Y1-Y0); auto sy1 = Y0 < Y1 ? 1 : -1;
-			auto dx2 =  abs(X2-X0); auto sx2 = X0 < X2 ? 1 : -1;
-			auto dy2 = -abs(Y2-Y0); auto sy2 = Y0 < Y2 ? 1 : -1;
+	//Half-space rasterizer: the clipped bounds are walked in 8x8 blocks aligned to the screen. Blocks outside an edge
+	//are skipped, blocks inside all edges are filled without tests, the rest are tested 8 pixels at a time.
+	//Edge values are stepped incrementally in exact integer arithmetic, so any split of the area gives the same pixels.
+	template<typename F>
+	void triangle_clipped(TriangleEdges const& te, rect2i clip, F&& f)
+	{
+		constexpr int B = 8;
+		const auto r = intersect(te.bounds, clip);
+		if(r.w <= 0 || r.h <= 0){ return; }
+		const int w = backbuffer.w();
+		Color8* data = backbuffer.data.data();
+		constexpr bool solid = std::is_convertible_v<F, Color8>;
+		auto plot = [&](Color8& p){ if constexpr(solid){ p = f; } else { p = f(p); } };
 
-			if(dx1 == 0 && dy1 == 0 && dx2 == 0 && dy2 == 0){ return; }
+		for(int by = r.y & ~(B-1); by < bottom(r); by += B)
+		{
+			const int y0 = std::max(by, r.y), y1 = std::min(by + B, bottom(r)) - 1;
+			for(int bx = r.x & ~(B-1); bx < right(r); bx += B)
+			{
+				const int x0 = std::max(bx, r.x), x1 = std::min(bx + B, right(r)) - 1;
 
-			auto err1 = dx1 + dy1; auto e21 = 0.0f; 
-			auto err2 = dx2 + dy2; auto e22 = 0.0f;
-			auto x01 = X0;
-			auto x02 = X0;
-			auto y01 = Y0;
-			auto y02 = Y0;
-			for (;;){
-				for(;;)
+				//classify the block by the edge values at its corners:
+				bool outside = false, inside = true;
+				long long erow[3];
+				bool straddle[3];
+				for(int k=0; k<3; ++k)
 				{
-					e21 = 2 * err1 + 0.5f;
-					if(e21 >= dy1){ err1 += dy1; x01 += sx1; }
-					if(e21 <= dx1){ err1 += dx1; break; }
+					const long long c00 = te.eval(k, x0, y0);
+					const long long c10 = c00 + te.a[k] * (x1 - x0);
+					const long long c01 = c00 + te.b[k] * (y1 - y0);
+					const long long c11 = c10 + te.b[k] * (y1 - y0);
+					const long long mn = std::min({c00, c10, c01, c11});
+					const long long mx = std::max({c00, c10, c01, c11});
+					if(mx < 0){ outside = true; break; }
+					straddle[k] = mn < 0;
+					inside = inside && !straddle[k];
+					erow[k] = c00;
 				}
-				for(;;)
+				if(outside){ continue; }
+
+				if(inside)
 				{
-					e22 = 2 * err2 + 0.5f;
-					if(e22 >= dy2){ err2 += dy2; x02 += sx2; }
-					if(e22 <= dx2){ err2 += dx2; break; }
+					for(int y=y0; y<=y1; ++y)
+					{
+						Color8* p = data + (ptrdiff_t)y * w + x0;
+						if constexpr(solid){ PixelKernels::fill_span(p, x1 - x0 + 1, f); }
+						else{ for(int x=x0; x<=x1; ++x, ++p){ *p = f(*p); } }
+					}
+					continue;
+				}
+
+				//edges the whole block is inside of always pass:
+				const unsigned int wmask = (1u << (x1 - x0 + 1)) - 1u;
+				for(int y=y0; y<=y1; ++y)
+				{
+					unsigned int m = wmask;
+					if(te.narrow)
+					{
+						int32_t e[3], a[3];
+						for(int k=0; k<3; ++k)
+						{
+							e[k] = straddle[k] ? (int32_t)erow[k] : 0;
+							a[k] = straddle[k] ? (int32_t)te.a[k] : 0;
+						}
+						m &= PixelKernels::edge_mask8(e, a);
+					}
+					else
+					{
+						unsigned int mm = 0;
+						for(int i=0; i<=x1-x0; ++i)
+						{
+							if(erow[0] + te.a[0]*i >= 0 && erow[1] + te.a[1]*i >= 0 && erow[2] + te.a[2]*i >= 0){ mm |= 1u << i; }
+						}
+						m &= mm;
+					}
+					Color8* p = data + (ptrdiff_t)y * w + x0;
+					for(; m != 0; m >>= 1, ++p){ if(m & 1){ plot(*p); } }
+					for(int k=0; k<3; ++k){ erow[k] += te.b[k]; }
 				}
-				hline(x01, x02, y01, iI, f);
-				y01 += sy1;
-				y02 += sy2;
-				if ((int)y01 > (int)ylim) break;
 			}
-		};
+		}
+	}
 
-		auto fillTopFlatTriangle = [&](T X0, T Y0, T X1, T Y1, T X2, T Y2, auto iI)
-		{
-			if(X0 > X1){ std::swap(X1, X0); std::swap(Y1, Y0); }
-			auto ylim = (int)std::max(Y0, Y1);
-			auto dx1 =  abs(X0 - X2); auto sx1 = X2 < X0 ? 1 : -1;
-			auto dy1 = -abs(Y0 - Y2); auto sy1 = Y2 < Y0 ? 1 : -1;
-			auto dx2 =  abs(X1 - X2); auto sx2 = X2 < X1 ? 1 : -1;
-			auto dy2 = -abs(Y1 - Y2); auto sy2 = Y2 < Y1 ? 1 : -1;
+	template<typename F>
+	void ellipse(int xm, int ym, int a, int b, F&& f)
+	{
+		barrier();
+		touch(span_bounds(xm-a, ym-b, xm+a, ym+b));
+		ellipse_clipped(xm, ym, a, b, clipRect(), std::forward<F>(f));
+	}
 
-			if(dx1 == 0 && dy1 == 0 && dx2 == 0 && dy2 == 0){ return; }
+	//Walks a quadrant of the ellipse with half axes a, b (Zingl's algorithm) and calls row(y, x0, x1) once for every
+	//row offset y in [0, b] that has pixels. x0 <= x1 <= 0 are the first and last x offsets on the row, the first
+	//one is the widest, so a filled ellipse is one span per row.
+	template<typename R>
+	static void ellipse_rows(int a, int b, R&& row)
+	{
+		long long x = -a, y = 0; /* II. quadrant from bottom left to top right */
+		long long e2 = b, dx = (1+2*x)*e2*e2; /* error increment */
+		long long dy = x*x, err = dx+dy; /* error of 1.step */
+		long long rowy = 0, first = x, last = x;
+		do
+		{
+			if(y != rowy){ row((int)rowy, (int)first, (int)last); rowy = y; first = x; }
+			last = x;
+			e2 = 2*err;
+			if (e2 >= dx) { x++; err += dx += 2*(long long)b*b; } /* x step */
+			if (e2 <= dy) { y++; err += dy += 2*(long long)a*a; } /* y step */
+		} while (x <= 0);
+		row((int)rowy, (int)first, (int)last);
+		while (y++ < b) { row((int)y, 0, 0); } /* to early stop for flat ellipses with a=1, -> finish tip of ellipse */
+	}
 
-			auto err1 = dx1 + dy1; auto e21 = 0.0f; 
-			auto err2 = dx2 + dy2; auto e22 = 0.0f;
+	//applies f (a Color8 or a callable) to the pixels [x0, x1] of row y inside clip:
+	template<typename F>
+	void span_clipped(int x0, int x1, int y, rect2i clip, F&& f)
+	{
+		if(y < top(clip) || y >= bottom(clip)){ return; }
+		x0 = std::max(x0, left(clip));
+		x1 = std::min(x1, right(clip)-1);
+		if(x0 > x1){ return; }
+		Color8* p = &backbuffer(x0, y);
+		if constexpr(std::is_convertible_v<F, Color8>){ PixelKernels::fill_span(p, x1 - x0 + 1, f); }
+		else{ for(int n = x1 - x0; n >= 0; --n, ++p){ *p = f(*p); } }
+	}
 
-			auto x01 = X2;
-			auto x02 = X2;
-			auto y01 = Y2;
-			auto y02 = Y2;
-			for (;;){
-				for(;;)
-				{
-					e21 = 2 * err1 + 0.5f;
-					if(e21 >= dy1){ err1 += dy1; x01 += sx1; }
-					if(e21 <= dx1){	err1 += dx1; break; }
-				}
-				for(;;)
-				{
-					e22 = 2 * err2 + 0.5f;
-					if(e22 >= dy2){ err2 += dy2; x02 += sx2; }
-					if(e22 <= dx2){ err2 += dx2; break; }
-				}
-				hline(x01, x02, y01, iI, f);
-				y01 += sy1;
-				y02 += sy2;
-				if ((int)y01 <= (int)ylim) break;
+	//the outline of the ellipse clipped per row, every pixel is touched once:
+	template<typename F>
+	void ellipse_clipped(int xm, int ym, int a, int b, rect2i clip, F&& f)
+	{
+		if(a < 0 || b < 0 || !overlaps(span_bounds(xm-a, ym-b, xm+a, ym+b), clip)){ return; }
+		ellipse_rows(a, b, [&](int y, int x0, int x1)
+		{
+			for(int yy : {ym-y, ym+y})
+			{
+				if(x1 == 0){ span_clipped(xm+x0, xm-x0, yy, clip, f); }
+				else       { span_clipped(xm+x0, xm+x1, yy, clip, f); span_clipped(xm-x1, xm-x0, yy, clip, f); }
+				if(y == 0){ break; }
 			}
-		};
+		});
+	}
 
-		auto xx1 = x1;
-		auto yy1 = y1;
-		auto xx2 = x2;
-		auto yy2 = y2;
-		if( x2 < x1 ){ std::swap(xx1, xx2); std::swap(yy1, yy2); }
-		auto iI = isInside(x0, y0, xx1, yy1, xx2, yy2);
+	template<typename F>
+	void filledellipse(int xm, int ym, int a, int b, F&& f)
+	{
+		barrier();
+		touch(span_bounds(xm-a, ym-b, xm+a, ym+b));
+		filledellipse_clipped(xm, ym, a, b, clipRect(), std::forward<F>(f));
+	}
+
+	//the filled ellipse as one span per row, clipped per row:
+	template<typename F>
+	void filledellipse_clipped(int xm, int ym, int a, int b, rect2i clip, F&& f)
+	{
+		if(a < 0 || b < 0 || !overlaps(span_bounds(xm-a, ym-b, xm+a, ym+b), clip)){ return; }
+		ellipse_rows(a, b, [&](int y, int x0, int)
+		{
+			span_clipped(xm+x0, xm-x0, ym-y, clip, f);
+			if(y != 0){ span_clipped(xm+x0, xm-x0, ym+y, clip, f); }
+		});
+	}
 
-		auto sx = (x0+x1+x2)/(T)3;
-		auto sy = (y0+y1+y2)/(T)3;
+	void filledellipse(int xm, int ym, int a, int b, Color8 col)
+	{
+		if(isDeferred()){ record(DrawOp::FilledEllipse, col, xm, ym, a, b, span_bounds(xm-a, ym-b, xm+a, ym+b)); return; }
+		filledellipse_clipped(xm, ym, a, b, clipRect(), col);
+		touch(span_bounds(xm-a, ym-b, xm+a, ym+b));
+	}
 
-		auto r = std::max(x2-x0, y2-y0);
-		const T scale = (T)1.0 + (T)(10.0 / r);
-		auto ex0 = (x0 - sx) * scale + sx;
-		auto ex1 = (x1 - sx) * scale + sx;
-		auto ex2 = (x2 - sx) * scale + sx;
+	void ellipse(int xm, int ym, int a, int b, Color8 col)
+	{
+		if(isDeferred()){ record(DrawOp::Ellipse, col, xm, ym, a, b, span_bounds(xm-a, ym-b, xm+a, ym+b)); return; }
+		ellipse_clipped(xm, ym, a, b, clipRect(), col);
+		touch(span_bounds(xm-a, ym-b, xm+a, ym+b));
+	}
 
-		auto ey0 = (y0 - sy) * scale + sy;
-		auto ey1 = (y1 - sy) * scale + sy;
-		auto ey2 = (y2 - sy) * scale + sy;
+	//Deferred rendering:
 
-		/*auto wh = [](auto ){ return bgr8(255, 255, 255); };
-		line(ex0, ey0, ex1, ey1, wh);
-		line(ex1, ey1, ex2, ey2, wh);
-		line(ex2, ey2, ex0, ey0, wh);*/
+	//damages r inside the clip rect:
+	void touch(rect2i r){ damage.add(intersect(r, clipRect())); }
 
-		if((int)y1 == (int)y2)
-		{
-			fillBottomFlatTriangle(ex0, ey0, ex1, ey1, ex2, ey2, iI);
-		}
-		else if((int)y0 == (int)y1)
+	//bounds of the pixels between two inclusive corners:
+	static rect2i span_bounds(int x0, int y0, int x1, int y1)
+	{
+		return rect2i{std::min(x0, x1), std::min(y0, y1), std::abs(x1 - x0) + 1, std::abs(y1 - y0) + 1};
+	}
+
+	void record(DrawOp op, Color8 col, int x0, int y0, int x1, int y1, rect2i bounds, unsigned int payload = 0, unsigned char mode = 0)
+	{
+		DrawCmd c{};
+		c.op = op; c.col = col; c.mode = mode;
+		c.x0 = x0; c.y0 = y0; c.x1 = x1; c.y1 = y1;
+		c.bounds  = intersect(bounds, clipRect());
+		c.payload = payload;
+		if(c.bounds.w > 0 && c.bounds.h > 0){ pending.cmds.push_back(c); }
+	}
+
+	//rasterizes one command, touching only the pixels inside clip and its (already clipped) bounds:
+	void execute(DrawCmd const& c, DrawList const& dl, rect2i area)
+	{
+		const auto clip = intersect(area, c.bounds);
+		auto col = c.col;
+		auto fcol = [=](auto){ return col; };
+		switch(c.op)
 		{
-			fillTopFlatTriangle(ex0, ey0, ex1, ey1, ex2, ey2, iI);
-		} 
-		else
+		case DrawOp::FilledRect:    fill_clipped(rect2i{c.x0, c.y0, c.x1, c.y1}, col, clip);                                        break;
+		case DrawOp::Line:          line_clipped(c.x0, c.y0, c.x1, c.y1, clip, fcol);                                               break;
+		case DrawOp::HLine:         hline_clipped(c.x0, c.x1, c.y0, col, clip);                                                     break;
+		case DrawOp::VLine:         vline_clipped(c.x0, c.y0, c.y1, col, clip);                                                     break;
+		case DrawOp::BlendMask:     blend_mask_clipped(dl.bytes(c.payload), c.x1, rect2i{c.x0, c.y0, c.x1, c.y1}, col, clip);       break;
+		case DrawOp::CopyImage:     copy_clipped((Color8 const*)dl.bytes(c.payload), c.x1, rect2i{c.x0, c.y0, c.x1, c.y1}, clip);   break;
+		case DrawOp::Composite:     composite_clipped((Color8 const*)dl.bytes(c.payload), c.x1, rect2i{c.x0, c.y0, c.x1, c.y1}, (CompositeOp)c.mode, clip); break;
+		case DrawOp::Ellipse:       ellipse_clipped(c.x0, c.y0, c.x1, c.y1, clip, col);                                             break;
+		case DrawOp::FilledEllipse: filledellipse_clipped(c.x0, c.y0, c.x1, c.y1, clip, col);                                       break;
+		case DrawOp::Triangle:
 		{
-			fillBottomFlatTriangle(ex0, ey0, ex1, ey1, ex2, ey2, iI);
-			fillTopFlatTriangle   (ex0, ey0, ex1, ey1, ex2, ey2, iI);
+			int32_t v[6];
+			memcpy(v, dl.bytes(c.payload), sizeof(v));
+			triangle_clipped(TriangleEdges::from_fixed(v), clip, col);
+			break;
+		}
 		}
 	}
 
-	template<typename F>
-	void ellipse(int xm, int ym, int a, int b, F&& f)
+	//rasterizes the pending commands:
+	void flush()
 	{
-		const int w = backbuffer.w();
-		const int h = backbuffer.h();
-		if(xm-a < 0 || ym-b < 0 || xm+a > w-1 || ym+b > h-1){ return; }
-		long x = -a, y = 0; /* II. quadrant from bottom left to top right */
-		long e2 = b, dx = (1+2*x)*e2*e2; /* error increment */
-		long dy = x*x, err = dx+dy; /* error of 1.step */
-		do
-		{
-			backbuffer(xm+x, ym-y) = f(backbuffer(xm+x, ym-y)); /* III. Quadrant */
-			backbuffer(xm-x, ym-y) = f(backbuffer(xm-x, ym-y)); /* IV. Quadrant */
-			backbuffer(xm-x, ym+y) = f(backbuffer(xm-x, ym+y)); /* I. Quadrant */
-			backbuffer(xm+x, ym+y) = f(backbuffer(xm+x, ym+y)); /* II. Quadrant */
-			e2 = 2*err;
-			if (e2 >= dx) { x++; err += dx += 2*(long)b*b; } /* x step */
-			if (e2 <= dy) { y++; err += dy += 2*(long)a*a; } /* y step */
-		} while (x <= 0);
-		while (y++ < b) { /* to early stop for flat ellipses with a=1, */
-			backbuffer(xm, ym+y) = f(backbuffer(xm, ym+y)); /* -> finish tip of ellipse */
-			backbuffer(xm, ym-y) = f(backbuffer(xm, ym-y)); 
-		}
+		if(pending.empty()){ return; }
+		replay(pending);
+		pending.clear();
 	}
 
-	template<typename F>
-	void filledellipse(int xm, int ym, int a, int b, F&& f)
+	//called before drawing immediately, the current frame can not be compared to the previous one then:
+	void barrier()
 	{
-		const int w = backbuffer.w();
-		const int h = backbuffer.h();
-		if(xm-a < 0 || ym-b < 0 || xm+a > w-1 || ym+b > h-1){ return; }
-		long x = -a, y = 0; /* II. quadrant from bottom left to top right */
-		long e2 = b, dx = (1+2*x)*e2*e2; /* error increment */
-		long dy = x*x, err = dx+dy; /* error of 1.step */
-		do
+		frameDirty = true;
+		flush();
+	}
+
+	//rasterizes a command list and damages the pixels it touches:
+	void replay(DrawList const& dl)
+	{
+		for(auto const& c : dl.cmds){ damage.add(c.bounds); }
+		rasterize(dl, backbuffer.rect());
+	}
+
+	//rasterizes the part of a command list inside area, in parallel over the screen tiles if there are workers:
+	void rasterize(DrawList const& dl, rect2i area)
+	{
+		if(dl.empty() || area.w <= 0 || area.h <= 0){ return; }
+		auto const& cmds = dl.cmds;
+		const int ntx = (area.w + tile_size - 1) / tile_size;
+		const int nty = (area.h + tile_size - 1) / tile_size;
+		if(!pool || ntx * nty < 2)
+		{
+			for(auto const& c : cmds){ if(overlaps(c.bounds, area)){ execute(c, dl, area); } }
+			return;
+		}
+
+		bins.resize((size_t)ntx * (size_t)nty);
+		for(auto& b : bins){ b.clear(); }
+		for(unsigned int i=0; i<(unsigned int)cmds.size(); ++i)
 		{
-			auto mn = std::min(xm-x, xm+x);
-			auto mx = std::max(xm-x, xm+x);
-			for(auto x_ = mn; x_ <= mx; ++x_)
+			auto b = intersect(cmds[i].bounds, area);
+			if(b.w <= 0 || b.h <= 0){ continue; }
+			b.shift_by(pos2i{-area.x, -area.y});
+			const int tx1 = (right(b) - 1) / tile_size;
+			const int ty1 = (bottom(b) - 1) / tile_size;
+			for(int ty = b.y / tile_size; ty <= ty1; ++ty)
 			{
-				backbuffer(x_, ym-y) = f(backbuffer(x_, ym-y)); //Quadrant III-IV
-				backbuffer(x_, ym+y) = f(backbuffer(x_, ym+y)); //Quadrant I-II
+				for(int tx = b.x / tile_size; tx <= tx1; ++tx){ bins[ty * ntx + tx].push_back(i); }
 			}
-			e2 = 2*err;
-			if (e2 >= dx) { x++; err += dx += 2*(long)b*b; } /* x step */
-			if (e2 <= dy) { y++; err += dy += 2*(long)a*a; } /* y step */
-		} while (x <= 0);
-		while (y++ < b) { /* to early stop for flat ellipses with a=1, */
-			backbuffer(xm, ym+y) = f(backbuffer(xm, ym+y)); /* -> finish tip of ellipse */
-			backbuffer(xm, ym-y) = f(backbuffer(xm, ym-y)); 
 		}
-	}
 
-	void filledellipse(int xm, int ym, int a, int b, Color8 col){ filledellipse(xm, ym, a, b, [=](auto){ return col; }); }
-	void ellipse      (int xm, int ym, int a, int b, Color8 col){ ellipse      (xm, ym, a, b, [=](auto){ return col; }); }
+		pool->run(ntx * nty, [&](int t)
+		{
+			auto const& bin = bins[t];
+			if(bin.empty()){ return; }
+			auto tile = intersect(rect2i{area.x + (t % ntx) * tile_size, area.y + (t / ntx) * tile_size, tile_size, tile_size}, area);
+			for(auto i : bin){ execute(cmds[i], dl, tile); }
+		});
+	}
 };
 
 struct MainWindow
@@ -1348,18 +2017,52 @@ struct MainWindow
 	HGDIOBJ				oldbmp;
 #else
 	GC					gc;
-	Pixmap				bmp;
+	Pixmap				bmp;		//not used when presentDirect
+	XImage*				image;		//aliases the presented image, recreated with the buffers
+	region2i			exposed;
+	bool				presentDirect;	//put the backbuffer straight to the window, without the intermediate pixmap
+
+	//MIT-SHM: the backbuffer lives in a shared segment the server reads from directly.
+	//The segment must not be drawn to while a put is in flight, shmPending is cleared by the completion event.
+	bool				useShm, shmPending;
+	int					shmCompletion;
+	XShmSegmentInfo		shminfo;
+	XImage*				shmimage;
+	BlockArena			shmarena;
+
+	//Render thread: onAppRender draws into renderer.backbuffer there, while the event thread presents front.
+	//A frame is started only when the render thread is idle, after onAppSync handed the state over.
+	//When it is done, the damaged rects are copied to front and presented on the event thread.
+	bool				threaded;
+	Image2<Color8>		front;
+	std::thread			renderThread;
+	std::mutex			renderMutex;
+	std::condition_variable renderCv;
+	bool				renderBusy, renderDone, renderQuit, renderAgain;
+	double				renderMs; //duration of the last frame on the render thread
+	int					shrinkTimer;
 #endif
 
-	std::function<void(void)> onAppStep, onAppExit;
+	//The buffers only grow, in steps, so resizing within their capacity allocates nothing.
+	//They shrink back once the window stayed much smaller than them for shrinkDelay ms.
+	size2<int>			capacity;
+	int					capacityStep;	//px
+	double				shrinkDelay;	//ms
+	std::chrono::steady_clock::time_point lastResize;
+
+	std::function<void(void)> onAppStep, onAppExit, onAppSync;
 	std::function<void(int, int, bool)> onAppResize;
 	std::function<void(SoftwareRenderer&)> onAppRender; 
-	MainWindow():onAppStep{[]{}}, onAppExit{[]{}}, onAppResize{[](int, int, bool){}}, onAppRender{[](SoftwareRenderer&){}}
+	MainWindow():capacity{0, 0}, capacityStep{128}, shrinkDelay{1000.0}, onAppStep{[]{}}, onAppExit{[]{}}, onAppSync{[]{}}, onAppResize{[](int, int, bool){}}, onAppRender{[](SoftwareRenderer&){}}
 	{
 #ifdef _WIN32
 		hdc = 0; bmp = 0; oldbmp = 0;
 #else
-		bmp = 0;
+		bmp = 0; image = nullptr; presentDirect = false;
+		useShm = false; shmPending = false; shmCompletion = -1;
+		shminfo = XShmSegmentInfo{}; shmimage = nullptr;
+		threaded = false; renderBusy = false; renderDone = false; renderQuit = false; renderAgain = false; renderMs = 0.0;
+		shrinkTimer = -1;
 #endif
 	}
 
@@ -1377,33 +2080,89 @@ struct MainWindow
 		relay.onResize = [&](int w, int h, bool m){ this->onResize(w, h, m); };
 
 		renderer.init(width(), height());
+		capacity = capacity_for(window.size);
+		renderer.reserve(capacity);
+#ifndef _WIN32
+		useShm = XShmQueryExtension(window.display) == True;
+		if(useShm)
+		{
+			shmCompletion = XShmGetEventBase(window.display) + ShmCompletion;
+			relay.onOtherEvent = [&](XEvent const& e){ if(e.type == shmCompletion){ shmPending = false; } };
+		}
+#endif
 		allocate_buffers();
 #ifdef _WIN32
 #else
 		gc = XCreateGC(window.display, window.handle, 0, 0);
+		relay.onExpose = [&](rect2i r){ exposed.add(intersect(r, rect2i{0, 0, width(), height()})); };
 #endif
 		onResize(width(), height(), false);
 
 		if( !finit() ){ return false; }
+#ifndef _WIN32
+		if(threaded){ start_render_thread(); }
+#endif
 		window.show();
 		window.loop(onAppStep);
+#ifndef _WIN32
+		stop_render_thread();
+#endif
 		renderer.close();
+		free_buffers();
 		return window.close();
 	}
 
 	void quit(){ window.quit(); }
 
+	//Presenting directly halves the server side copies, but exposed areas are then refilled from the backbuffer.
+	//Call before open():
+	void setPresentDirect(bool d)
+	{
+#ifndef _WIN32
+		presentDirect = d;
+#else
+		(void)d;
+#endif
+	}
+
+	//With a render thread the render handler runs there, input handlers stay on the event thread.
+	//The sync handler runs on the event thread before each frame while the render thread is idle,
+	//it should hand over everything the render handler reads. Call before open(), X11 only:
+	void setRenderThread(bool t)
+	{
+#ifndef _WIN32
+		threaded = t;
+#else
+		(void)t;
+#endif
+	}
+
 	template<typename F> void      exitHandler(F&& f){ onAppExit   = std::forward<F>(f); }
+	template<typename F> void      syncHandler(F&& f){ onAppSync   = std::forward<F>(f); }
 	template<typename F> void      idleHandler(F&& f){ onAppStep   = std::forward<F>(f); }
 	template<typename F> void    renderHandler(F&& f){ onAppRender = std::forward<F>(f); }
 	template<typename F> void    resizeHandler(F&& f){ onAppResize = std::forward<F>(f); }
 	template<typename F> void     mouseHandler(F&& f){ MainWindowDetails::relay.onMouseEvent    = std::forward<F>(f); }
 	template<typename F> void  keyboardHandler(F&& f){ MainWindowDetails::relay.onKeyboardEvent = std::forward<F>(f); }
+
+	//the pointer positions merged into the current Move event, oldest first:
+	std::vector<pos2<int>> const& motionHistory() const { return MainWindowDetails::relay.motionHistory; }
+
 	void onRender()
 	{
 		//printf("OnRender\n");
 		if(window.size.area() == 0){ return; }
+#ifndef _WIN32
+		if(threaded){ return request_frame(); }
+		wait_shm();
+#endif
+		MINIGUI_PROFILE_FRAME();
+		MINIGUI_PROFILE_PHASE(Frame);
+		onAppSync();
+		renderer.beginFrame();
 		onAppRender(renderer);
+		renderer.endFrame();
+		MINIGUI_PROFILE_PHASE(Present);
 
 #ifdef _WIN32
 		PAINTSTRUCT ps;
@@ -1423,24 +2182,179 @@ struct MainWindow
 		//ValidateRect(window.handle, NULL);
 #else
 		//renderer.forall_pixels([](auto x, auto y, auto){ return color8(0, 0, 64); });
-		XImage* image = XCreateImage(window.display, window.visual, window.depth, ZPixmap, 0, (char*)renderer.backbuffer.data.data(), width(), height(), 32, 0);
-		XPutImage(window.display, bmp, gc, image, 0, 0, 0, 0, width(), height());
-		XFree(image);
-		XCopyArea(window.display, bmp, window.handle, gc, 0, 0, width(), height(), 0, 0);
-		XFlush(window.display);
+		present(renderer.backbuffer, renderer.getDamage());
 #endif
+		renderer.clearDamage();
+	}
+
+#ifndef _WIN32
+	//upload only the damaged pixels to the pixmap, then show them and whatever the server lost.
+	//When presenting directly the lost areas are uploaded from the image too:
+	void present(Image2<Color8> const& img, region2i const& damage)
+	{
+		exposed.add(damage);
+		if(!exposed.empty())
+		{
+			Drawable target = presentDirect ? (Drawable)window.handle : (Drawable)bmp;
+			auto const& puts = presentDirect ? exposed : damage;
+			if(!puts.empty() && shmimage && shmarena.owns(img.data.data()))
+			{
+				//only the last put asks for a completion event, they complete in order:
+				for(size_t i=0; i<puts.rects.size(); ++i)
+				{
+					auto const& r = puts.rects[i];
+					XShmPutImage(window.display, target, gc, shmimage, r.x, r.y, r.x, r.y, r.w, r.h, i + 1 == puts.rects.size() ? True : False);
+				}
+				shmPending = true;
+			}
+			else if(image)
+			{
+				image->data = (char*)img.data.data();
+				for(auto const& r : puts.rects){ XPutImage(window.display, target, gc, image, r.x, r.y, r.x, r.y, r.w, r.h); }
+			}
+			if(!presentDirect)
+			{
+				for(auto const& r : exposed.rects){ XCopyArea(window.display, bmp, window.handle, gc, r.x, r.y, r.w, r.h, r.x, r.y); }
+			}
+			XFlush(window.display);
+		}
+		exposed.clear();
+	}
+
+	Image2<Color8>& presented(){ return threaded ? front : renderer.backbuffer; }
+
+	//moves the presented pixels to memory from arena, nullptr for the heap:
+	void set_arena(PixelArena* arena)
+	{
+		if(threaded)
+		{
+			front.data = decltype(front.data)(PixelAllocator<Color8>{arena});
+			front.data.reserve((size_t)capacity.area());
+			front.resize({width(), height()});
+			renderer.damageAll();
+		}
+		else{ renderer.setPixelArena(arena, (size_t)capacity.area()); }
 	}
 
+	void start_render_thread()
+	{
+		renderBusy = false; renderDone = false; renderQuit = false; renderMs = 0.0;
+		window.scheduler.asyncFrames = true;
+		renderThread = std::thread([this]
+		{
+			std::unique_lock<std::mutex> lock(renderMutex);
+			while(true)
+			{
+				renderCv.wait(lock, [this]{ return renderQuit || (renderBusy && !renderDone); });
+				if(renderQuit){ break; }
+				lock.unlock();
+				auto t0 = FrameScheduler::clock::now();
+				{
+					MINIGUI_PROFILE_FRAME();
+					MINIGUI_PROFILE_PHASE(Frame);
+					renderer.beginFrame();
+					onAppRender(renderer);
+					renderer.endFrame();
+					renderer.flush();
+				}
+				auto ms = FrameScheduler::ms(FrameScheduler::clock::now() - t0);
+				lock.lock();
+				renderMs = ms;
+				renderDone = true;
+				renderCv.notify_all();
+				window.post([this]{ this->swap_frame(); });
+			}
+		});
+	}
+
+	void stop_render_thread()
+	{
+		if(!renderThread.joinable()){ return; }
+		{
+			std::lock_guard<std::mutex> lock(renderMutex);
+			renderQuit = true;
+		}
+		renderCv.notify_all();
+		renderThread.join();
+		window.scheduler.asyncFrames = false;
+	}
+
+	//blocks until no frame is being drawn, a finished frame is dropped, the caller damages what it changes:
+	void wait_render()
+	{
+		if(!renderThread.joinable()){ return; }
+		std::unique_lock<std::mutex> lock(renderMutex);
+		renderCv.wait(lock, [this]{ return !renderBusy || renderDone; });
+		if(renderBusy){ renderBusy = false; renderDone = false; renderAgain = true; }
+	}
+
+	//on the event thread: starts a frame if the render thread is idle, exposed areas are served from front meanwhile.
+	void request_frame()
+	{
+		bool idle;
+		{
+			std::lock_guard<std::mutex> lock(renderMutex);
+			idle = !renderBusy;
+			if(!idle){ renderAgain = true; }
+		}
+		if(idle)
+		{
+			onAppSync();
+			{
+				std::lock_guard<std::mutex> lock(renderMutex);
+				renderBusy = true; renderDone = false;
+			}
+			renderCv.notify_all();
+		}
+		if(!exposed.empty()){ present(front, region2i{}); }
+	}
+
+	//on the event thread when a frame is done: copies the damaged rects to front and presents them.
+	//The scheduler paces frames with the cost of drawing plus presenting, request_frame itself returns at once.
+	void swap_frame()
+	{
+		double ms;
+		{
+			std::lock_guard<std::mutex> lock(renderMutex);
+			if(!renderDone){ return; }
+			ms = renderMs;
+		}
+		auto t0 = FrameScheduler::clock::now();
+		MINIGUI_PROFILE_PHASE(Present);
+		wait_shm();
+		auto const& damage = renderer.getDamage();
+		for(auto const& r : damage.rects)
+		{
+			for(int y=r.y; y<r.y+r.h; ++y)
+			{
+				auto src = renderer.backbuffer.data.data() + (size_t)y * width() + r.x;
+				std::copy(src, src + r.w, front.data.data() + (size_t)y * width() + r.x);
+			}
+		}
+		present(front, damage);
+		renderer.clearDamage();
+		window.scheduler.rendered(ms + FrameScheduler::ms(FrameScheduler::clock::now() - t0));
+		{
+			std::lock_guard<std::mutex> lock(renderMutex);
+			renderBusy = false; renderDone = false;
+		}
+		if(renderAgain){ renderAgain = false; window.redraw(); }
+	}
+#endif
+
 	void allocate_buffers()
 	{
 #ifdef _WIN32
 		auto dcw = GetDC(window.handle);
 		hdc    = CreateCompatibleDC(dcw);
-		bmp    = CreateCompatibleBitmap(dcw, width(), height());
+		bmp    = CreateCompatibleBitmap(dcw, capacity.w, capacity.h);
 		oldbmp = SelectObject(hdc, bmp);
 		ReleaseDC(window.handle, dcw);
 #else
-		bmp = XCreatePixmap(window.display, window.handle, width(), height(), window.depth);
+		if(!presentDirect){ bmp = XCreatePixmap(window.display, window.handle, capacity.w, capacity.h, window.depth); }
+		if(threaded){ front.reserve((size_t)capacity.area()); front.resize({width(), height()}); }
+		if(useShm && !create_shm()){ useShm = false; }
+		if(!shmimage){ image = XCreateImage(window.display, window.visual, window.depth, ZPixmap, 0, (char*)presented().data.data(), width(), height(), 32, 0); }
 #endif
 	}
 
@@ -1454,19 +2368,138 @@ struct MainWindow
 			DeleteDC(hdc);
 		}
 #else
-		if(bmp){ XFreePixmap(window.display, bmp); }
+		wait_render();
+		destroy_shm();
+		//the pixels belong to the renderer:
+		if(image){ image->data = nullptr; XDestroyImage(image); image = nullptr; }
+		if(bmp){ XFreePixmap(window.display, bmp); bmp = 0; }
 #endif
 	}
 
+#ifndef _WIN32
+	static int& shmError(){ static int e = 0; return e; }
+
+	//creates a shared segment for the backbuffer and attaches it to the server,
+	//fails for example on remote displays, then the plain XPutImage path is used:
+	bool create_shm()
+	{
+		const size_t bytes = (size_t)capacity.area() * sizeof(Color8);
+		shmimage = XShmCreateImage(window.display, window.visual, window.depth, ZPixmap, nullptr, &shminfo, width(), height());
+		if(!shmimage){ return false; }
+		if(shmimage->bits_per_pixel != 32 || shmimage->bytes_per_line != width() * 4){ XDestroyImage(shmimage); shmimage = nullptr; return false; }
+
+		shminfo.shmid = shmget(IPC_PRIVATE, bytes, IPC_CREAT | 0600);
+		if(shminfo.shmid < 0){ XDestroyImage(shmimage); shmimage = nullptr; return false; }
+		shminfo.shmaddr = shmimage->data = (char*)shmat(shminfo.shmid, nullptr, 0);
+		shminfo.readOnly = True;
+		bool ok = shminfo.shmaddr != (char*)-1;
+		if(ok)
+		{
+			shmError() = 0;
+			auto old = XSetErrorHandler([](Display*, XErrorEvent*){ shmError() = 1; return 0; });
+			XShmAttach(window.display, &shminfo);
+			XSync(window.display, False);
+			XSetErrorHandler(old);
+			ok = shmError() == 0;
+			if(!ok){ shmdt(shminfo.shmaddr); }
+		}
+		//the segment is freed once both sides detached:
+		shmctl(shminfo.shmid, IPC_RMID, nullptr);
+		if(!ok){ shmimage->data = nullptr; XDestroyImage(shmimage); shmimage = nullptr; shminfo = XShmSegmentInfo{}; return false; }
+
+		shmarena.reset(shminfo.shmaddr, bytes);
+		set_arena(&shmarena);
+		return true;
+	}
+
+	void destroy_shm()
+	{
+		if(!shmimage){ return; }
+		wait_shm();
+		set_arena(nullptr);
+		XShmDetach(window.display, &shminfo);
+		XSync(window.display, False);
+		shmimage->data = nullptr;
+		XDestroyImage(shmimage);
+		shmimage = nullptr;
+		shmdt(shminfo.shmaddr);
+		shminfo = XShmSegmentInfo{};
+		shmarena.reset(nullptr, 0);
+	}
+
+	//blocks until the server finished reading the segment:
+	void wait_shm()
+	{
+		if(!shmPending){ return; }
+		XEvent e;
+		XIfEvent(window.display, &e, [](Display*, XEvent* ev, XPointer arg){ return ev->type == *(int*)arg ? True : False; }, (XPointer)&shmCompletion);
+		shmPending = false;
+	}
+#endif
+
+	//the capacity for a window of size s, with some slack and rounded up to whole steps:
+	size2<int> capacity_for(size2<int> s) const
+	{
+		auto up = [&](int x){ x += x / 8; return (x + capacityStep - 1) / capacityStep * capacityStep; };
+		return {std::max(capacityStep, up(s.w)), std::max(capacityStep, up(s.h))};
+	}
+	bool fits(size2<int> s) const { return s.w <= capacity.w && s.h <= capacity.h; }
+	bool wasteful() const { return (size_t)capacity_for(window.size).area() * 2 <= (size_t)capacity.area(); }
+
+	//drops the buffers and makes new ones with capacity cap, the content is lost:
+	void reallocate(size2<int> cap, size2<int> sz)
+	{
+		free_buffers();
+		capacity = cap;
+		renderer.reserve(capacity);
+		renderer.resize(sz.w, sz.h);
+		window.size = sz;
+		allocate_buffers();
+	}
+
+	//resizes within the capacity, the images keep their memory and only their header changes:
+	void fit_buffers(size2<int> sz)
+	{
+#ifndef _WIN32
+		wait_render();
+		wait_shm();
+#endif
+		renderer.resize(sz.w, sz.h);
+		window.size = sz;
+#ifndef _WIN32
+		if(threaded){ front.resize(sz); }
+		for(XImage* im : {image, shmimage})
+		{
+			if(im){ im->width = sz.w; im->height = sz.h; im->bytes_per_line = sz.w * (int)sizeof(Color8); }
+		}
+#endif
+	}
+
+	//called by the shrink timer, which every resize re-arms, so the delay has passed since the last resize:
+	void shrink()
+	{
+		if(!wasteful()){ return; }
+		reallocate(capacity_for(window.size), window.size);
+		window.redraw();
+	}
+
 	void onResize(int w, int h, bool)
 	{
 		bool m = (w == width()) && (h == height());
 		if(!m)
 		{
-			free_buffers();
-			renderer.resize(w, h);
-			window.size.w = w; window.size.h = h; 
-			allocate_buffers();
+			size2<int> sz{w, h};
+#ifdef _WIN32
+			//without timers the shrink happens at a resize after the delay:
+			if(!fits(sz) || (wasteful() && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - lastResize).count() >= shrinkDelay)){ reallocate(capacity_for(sz), sz); }
+			else{ fit_buffers(sz); }
+#else
+			if(!fits(sz)){ reallocate(capacity_for(sz), sz); }
+			else{ fit_buffers(sz); }
+			if(shrinkTimer >= 0){ window.cancelTimer(shrinkTimer); shrinkTimer = -1; }
+			if(wasteful()){ shrinkTimer = window.setTimer(shrinkDelay, [this]{ shrinkTimer = -1; shrink(); }); }
+#endif
+			lastResize = std::chrono::steady_clock::now();
 		}
 		onAppResize(w, h, m);
 		if(!m)
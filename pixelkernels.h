@@ -0,0 +1,463 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include "graphics_base.h"
+
+//SIMD pixel kernels operating on rows of BGRA (Color8) pixels.
+//Every kernel has a scalar, an SSE2 and an AVX2 version, the best one is selected at runtime.
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MINIGUI_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MINIGUI_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define MINIGUI_TARGET_AVX2
+#endif
+
+static_assert(sizeof(Color8) == 4, "Color8 must be a packed 32 bit pixel");
+
+inline uint32_t pack32(Color8 c){ uint32_t v; memcpy(&v, &c, 4); return v; }
+inline Color8 unpack32(uint32_t v){ Color8 c; memcpy(&c, &v, 4); return c; }
+
+namespace PixelKernels
+{
+	enum class Level { Scalar, SSE2, AVX2 };
+
+	inline Level detect_level()
+	{
+#ifdef MINIGUI_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+		int r[4];
+		__cpuid(r, 0);
+		if(r[0] >= 7)
+		{
+			__cpuid(r, 1);
+			bool osxsave = (r[2] & (1 << 27)) != 0;
+			bool avx     = (r[2] & (1 << 28)) != 0;
+			__cpuidex(r, 7, 0);
+			bool avx2 = (r[1] & (1 << 5)) != 0;
+			if(osxsave && avx && avx2 && (_xgetbv(0) & 6) == 6){ return Level::AVX2; }
+		}
+#else
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2")){ return Level::AVX2; }
+#endif
+		return Level::SSE2;
+#else
+		return Level::Scalar;
+#endif
+	}
+
+	//Spans larger than this (in pixels) are written with non-temporal stores, they would only evict the cache anyway:
+	constexpr int streaming_threshold = 1 << 18;
+
+	//fill span:
+	inline void fill_span_scalar(Color8* dst, int n, Color8 c){ std::fill_n(dst, n, c); }
+
+#ifdef MINIGUI_X86
+	inline void fill_span_sse2(Color8* dst, int n, Color8 c)
+	{
+		if(((uintptr_t)dst & 3) != 0){ fill_span_scalar(dst, n, c); return; }
+		const __m128i v = _mm_set1_epi32((int)pack32(c));
+		int i = 0;
+		while(i < n && ((uintptr_t)(dst + i) & 15) != 0){ dst[i] = c; ++i; }
+		if(n - i >= streaming_threshold)
+		{
+			for(; i + 16 <= n; i += 16)
+			{
+				_mm_stream_si128((__m128i*)(dst + i),      v);
+				_mm_stream_si128((__m128i*)(dst + i +  4), v);
+				_mm_stream_si128((__m128i*)(dst + i +  8), v);
+				_mm_stream_si128((__m128i*)(dst + i + 12), v);
+			}
+			_mm_sfence();
+		}
+		for(; i + 16 <= n; i += 16)
+		{
+			_mm_store_si128((__m128i*)(dst + i),      v);
+			_mm_store_si128((__m128i*)(dst + i +  4), v);
+			_mm_store_si128((__m128i*)(dst + i +  8), v);
+			_mm_store_si128((__m128i*)(dst + i + 12), v);
+		}
+		for(; i + 4 <= n; i += 4){ _mm_store_si128((__m128i*)(dst + i), v); }
+		for(; i < n; ++i){ dst[i] = c; }
+	}
+
+	MINIGUI_TARGET_AVX2 inline void fill_span_avx2(Color8* dst, int n, Color8 c)
+	{
+		if(((uintptr_t)dst & 3) != 0){ fill_span_scalar(dst, n, c); return; }
+		const __m256i v = _mm256_set1_epi32((int)pack32(c));
+		int i = 0;
+		if(n >= 8)
+		{
+			//one unaligned store covers the head, then continue from the next 32 byte boundary:
+			_mm256_storeu_si256((__m256i*)dst, v);
+			i = (int)((32 - ((uintptr_t)dst & 31)) & 31) / 4;
+		}
+		if(n - i >= streaming_threshold)
+		{
+			for(; i + 32 <= n; i += 32)
+			{
+				_mm256_stream_si256((__m256i*)(dst + i),      v);
+				_mm256_stream_si256((__m256i*)(dst + i +  8), v);
+				_mm256_stream_si256((__m256i*)(dst + i + 16), v);
+				_mm256_stream_si256((__m256i*)(dst + i + 24), v);
+			}
+			_mm_sfence();
+		}
+		for(; i + 32 <= n; i += 32)
+		{
+			_mm256_store_si256((__m256i*)(dst + i),      v);
+			_mm256_store_si256((__m256i*)(dst + i +  8), v);
+			_mm256_store_si256((__m256i*)(dst + i + 16), v);
+			_mm256_store_si256((__m256i*)(dst + i + 24), v);
+		}
+		for(; i + 8 <= n; i += 8){ _mm256_store_si256((__m256i*)(dst + i), v); }
+		//the tail is covered by one overlapping unaligned store:
+		if(i < n)
+		{
+			if(n >= 8){ _mm256_storeu_si256((__m256i*)(dst + n - 8), v); }
+			else      { for(; i < n; ++i){ dst[i] = c; } }
+		}
+	}
+#endif
+
+	//blend span: dst = blend8(dst, mask, c) per pixel, bit-identical to blend8.
+	//blend8 truncates x/255, for x <= 255*255 this is exactly (x + 1 + (x >> 8)) >> 8, which is used in the SIMD versions.
+	inline void blend_mask_span_scalar(Color8* dst, const unsigned char* mask, int n, Color8 c)
+	{
+		for(int i=0; i<n; ++i)
+		{
+			auto a = mask[i];
+			if     (a == 255){ dst[i] = c; }
+			else if(a !=   0){ dst[i] = blend8(dst[i], a, c); }
+		}
+	}
+
+#ifdef MINIGUI_X86
+	//blends 4 pixels, m16 holds the coverage of the 4 pixels in its lower 4 16 bit lanes:
+	inline __m128i blend4_sse2(__m128i d, __m128i m16, __m128i s16)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i c255 = _mm_set1_epi16(255);
+		const __m128i one  = _mm_set1_epi16(1);
+		__m128i m2 = _mm_unpacklo_epi16(m16, m16);
+		__m128i qlo = _mm_unpacklo_epi32(m2, m2);
+		__m128i qhi = _mm_unpackhi_epi32(m2, m2);
+		__m128i dlo = _mm_unpacklo_epi8(d, zero);
+		__m128i dhi = _mm_unpackhi_epi8(d, zero);
+		__m128i xlo = _mm_add_epi16(_mm_mullo_epi16(dlo, _mm_sub_epi16(c255, qlo)), _mm_mullo_epi16(s16, qlo));
+		__m128i xhi = _mm_add_epi16(_mm_mullo_epi16(dhi, _mm_sub_epi16(c255, qhi)), _mm_mullo_epi16(s16, qhi));
+		xlo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(xlo, one), _mm_srli_epi16(xlo, 8)), 8);
+		xhi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(xhi, one), _mm_srli_epi16(xhi, 8)), 8);
+		return _mm_packus_epi16(xlo, xhi);
+	}
+
+	//8 pixels per step, runs of fully transparent or fully opaque coverage are skipped or filled:
+	inline void blend_mask_span_sse2(Color8* dst, const unsigned char* mask, int n, Color8 c)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i ones = _mm_set1_epi8((char)255);
+		const __m128i s32  = _mm_set1_epi32((int)pack32(c));
+		const __m128i s16  = _mm_unpacklo_epi8(s32, zero);
+		int i = 0;
+		for(; i + 8 <= n; i += 8)
+		{
+			__m128i m = _mm_loadl_epi64((const __m128i*)(mask + i));
+			if((_mm_movemask_epi8(_mm_cmpeq_epi8(m, zero)) & 0xFF) == 0xFF){ continue; }
+			__m128i* p = (__m128i*)(dst + i);
+			if((_mm_movemask_epi8(_mm_cmpeq_epi8(m, ones)) & 0xFF) == 0xFF)
+			{
+				_mm_storeu_si128(p, s32); _mm_storeu_si128(p+1, s32);
+				continue;
+			}
+			__m128i m16 = _mm_unpacklo_epi8(m, zero);
+			_mm_storeu_si128(p,   blend4_sse2(_mm_loadu_si128(p),   m16,                     s16));
+			_mm_storeu_si128(p+1, blend4_sse2(_mm_loadu_si128(p+1), _mm_srli_si128(m16, 8), s16));
+		}
+		blend_mask_span_scalar(dst + i, mask + i, n - i, c);
+	}
+
+	//blends 8 pixels, m32 holds the coverage of pixel 0-3 and 4-7 in the 32 bit lanes of the two halves:
+	MINIGUI_TARGET_AVX2 inline __m256i blend8_avx2(__m256i d, __m256i m32, __m256i s16)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i c255 = _mm256_set1_epi16(255);
+		const __m256i one  = _mm256_set1_epi16(1);
+		__m256i m2  = _mm256_or_si256(m32, _mm256_slli_epi32(m32, 16));
+		__m256i qlo = _mm256_unpacklo_epi32(m2, m2);
+		__m256i qhi = _mm256_unpackhi_epi32(m2, m2);
+		__m256i dlo = _mm256_unpacklo_epi8(d, zero);
+		__m256i dhi = _mm256_unpackhi_epi8(d, zero);
+		__m256i xlo = _mm256_add_epi16(_mm256_mullo_epi16(dlo, _mm256_sub_epi16(c255, qlo)), _mm256_mullo_epi16(s16, qlo));
+		__m256i xhi = _mm256_add_epi16(_mm256_mullo_epi16(dhi, _mm256_sub_epi16(c255, qhi)), _mm256_mullo_epi16(s16, qhi));
+		xlo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(xlo, one), _mm256_srli_epi16(xlo, 8)), 8);
+		xhi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(xhi, one), _mm256_srli_epi16(xhi, 8)), 8);
+		return _mm256_packus_epi16(xlo, xhi);
+	}
+
+	//16 pixels per step, runs of fully transparent or fully opaque coverage are skipped or filled:
+	MINIGUI_TARGET_AVX2 inline void blend_mask_span_avx2(Color8* dst, const unsigned char* mask, int n, Color8 c)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i ones = _mm_set1_epi8((char)255);
+		const __m256i s32  = _mm256_set1_epi32((int)pack32(c));
+		const __m256i s16  = _mm256_unpacklo_epi8(s32, _mm256_setzero_si256());
+		int i = 0;
+		for(; i + 16 <= n; i += 16)
+		{
+			__m128i m = _mm_loadu_si128((const __m128i*)(mask + i));
+			if(_mm_movemask_epi8(_mm_cmpeq_epi8(m, zero)) == 0xFFFF){ continue; }
+			__m256i* p = (__m256i*)(dst + i);
+			if(_mm_movemask_epi8(_mm_cmpeq_epi8(m, ones)) == 0xFFFF)
+			{
+				_mm256_storeu_si256(p, s32); _mm256_storeu_si256(p+1, s32);
+				continue;
+			}
+			_mm256_storeu_si256(p,   blend8_avx2(_mm256_loadu_si256(p),   _mm256_cvtepu8_epi32(m),                    s16));
+			_mm256_storeu_si256(p+1, blend8_avx2(_mm256_loadu_si256(p+1), _mm256_cvtepu8_epi32(_mm_srli_si128(m, 8)), s16));
+		}
+		blend_mask_span_sse2(dst + i, mask + i, n - i, c);
+	}
+#endif
+
+	//edge test for triangle rasterization: bit i of the result is set if e[k] + i * a[k] >= 0 for all three edges,
+	//i.e. pixel i of a row of 8 is inside. The caller guarantees that the values fit in 32 bits.
+	inline unsigned int edge_mask8_scalar(const int32_t* e, const int32_t* a)
+	{
+		unsigned int m = 0;
+		for(int i=0; i<8; ++i)
+		{
+			if(e[0] + i * a[0] >= 0 && e[1] + i * a[1] >= 0 && e[2] + i * a[2] >= 0){ m |= 1u << i; }
+		}
+		return m;
+	}
+
+#ifdef MINIGUI_X86
+	inline unsigned int edge_mask8_sse2(const int32_t* e, const int32_t* a)
+	{
+		__m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+		for(int k=0; k<3; ++k)
+		{
+			__m128i v = _mm_add_epi32(_mm_set1_epi32(e[k]), _mm_set_epi32(3*a[k], 2*a[k], a[k], 0));
+			lo = _mm_or_si128(lo, v);
+			hi = _mm_or_si128(hi, _mm_add_epi32(v, _mm_set1_epi32(4*a[k])));
+		}
+		//a sign bit in any of the three values means outside:
+		return ~(unsigned int)(_mm_movemask_ps(_mm_castsi128_ps(lo)) | (_mm_movemask_ps(_mm_castsi128_ps(hi)) << 4)) & 0xFF;
+	}
+
+	MINIGUI_TARGET_AVX2 inline unsigned int edge_mask8_avx2(const int32_t* e, const int32_t* a)
+	{
+		const __m256i lane = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+		__m256i o = _mm256_setzero_si256();
+		for(int k=0; k<3; ++k){ o = _mm256_or_si256(o, _mm256_add_epi32(_mm256_set1_epi32(e[k]), _mm256_mullo_epi32(_mm256_set1_epi32(a[k]), lane))); }
+		return ~(unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(o)) & 0xFF;
+	}
+#endif
+
+	//composite span on premultiplied pixels: dst = composite8(op, dst, src) per pixel, bit-identical to composite8.
+	inline void composite_span_scalar(Color8* dst, const Color8* src, int n, CompositeOp op)
+	{
+		if(op == CompositeOp::Copy){ memcpy(dst, src, (size_t)n * sizeof(Color8)); return; }
+		for(int i=0; i<n; ++i){ dst[i] = composite8(op, dst[i], src[i]); }
+	}
+
+#ifdef MINIGUI_X86
+	//alpha of each pixel broadcast to its 4 16 bit lanes, and the rounded, saturating x/255 of composite_channel:
+	inline __m128i alpha16_sse2(__m128i x){ return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xFF), 0xFF); }
+	inline __m128i div255_sse2(__m128i x){ x = _mm_adds_epu16(x, _mm_set1_epi16(128)); return _mm_srli_epi16(_mm_adds_epu16(x, _mm_srli_epi16(x, 8)), 8); }
+
+	//SrcOver or Multiply of 2 pixels unpacked to 16 bit lanes:
+	template<CompositeOp op>
+	inline __m128i composite2_sse2(__m128i d, __m128i s)
+	{
+		const __m128i c255 = _mm_set1_epi16(255);
+		if constexpr(op == CompositeOp::SrcOver){ return _mm_add_epi16(s, div255_sse2(_mm_mullo_epi16(d, _mm_sub_epi16(c255, alpha16_sse2(s))))); }
+		else
+		{
+			__m128i t1 = _mm_mullo_epi16(s, _mm_add_epi16(_mm_sub_epi16(c255, alpha16_sse2(d)), d));
+			__m128i t2 = _mm_mullo_epi16(d, _mm_sub_epi16(c255, alpha16_sse2(s)));
+			return div255_sse2(_mm_adds_epu16(t1, t2));
+		}
+	}
+
+	//4 pixels per step, SrcOver skips transparent and copies opaque runs of 4:
+	template<CompositeOp op>
+	inline void composite_span_sse2_op(Color8* dst, const Color8* src, int n)
+	{
+		const __m128i zero  = _mm_setzero_si128();
+		const __m128i amask = _mm_set1_epi32((int)0xFF000000u);
+		int i = 0;
+		for(; i + 4 <= n; i += 4)
+		{
+			__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+			__m128i* p = (__m128i*)(dst + i);
+			if constexpr(op == CompositeOp::Add){ _mm_storeu_si128(p, _mm_adds_epu8(_mm_loadu_si128(p), s)); continue; }
+			if constexpr(op == CompositeOp::SrcOver)
+			{
+				if(_mm_movemask_epi8(_mm_cmpeq_epi8(s, zero)) == 0xFFFF){ continue; }
+				if(_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, amask), amask)) == 0xFFFF){ _mm_storeu_si128(p, s); continue; }
+			}
+			__m128i d = _mm_loadu_si128(p);
+			__m128i lo = composite2_sse2<op>(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero));
+			__m128i hi = composite2_sse2<op>(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero));
+			_mm_storeu_si128(p, _mm_packus_epi16(lo, hi));
+		}
+		composite_span_scalar(dst + i, src + i, n - i, op);
+	}
+
+	inline void composite_span_sse2(Color8* dst, const Color8* src, int n, CompositeOp op)
+	{
+		switch(op)
+		{
+		case CompositeOp::Copy:     composite_span_scalar(dst, src, n, op);                   break;
+		case CompositeOp::SrcOver:  composite_span_sse2_op<CompositeOp::SrcOver >(dst, src, n); break;
+		case CompositeOp::Add:      composite_span_sse2_op<CompositeOp::Add     >(dst, src, n); break;
+		case CompositeOp::Multiply: composite_span_sse2_op<CompositeOp::Multiply>(dst, src, n); break;
+		}
+	}
+
+	MINIGUI_TARGET_AVX2 inline __m256i alpha16_avx2(__m256i x){ return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x, 0xFF), 0xFF); }
+	MINIGUI_TARGET_AVX2 inline __m256i div255_avx2(__m256i x){ x = _mm256_adds_epu16(x, _mm256_set1_epi16(128)); return _mm256_srli_epi16(_mm256_adds_epu16(x, _mm256_srli_epi16(x, 8)), 8); }
+
+	template<CompositeOp op>
+	MINIGUI_TARGET_AVX2 inline __m256i composite4_avx2(__m256i d, __m256i s)
+	{
+		const __m256i c255 = _mm256_set1_epi16(255);
+		if constexpr(op == CompositeOp::SrcOver){ return _mm256_add_epi16(s, div255_avx2(_mm256_mullo_epi16(d, _mm256_sub_epi16(c255, alpha16_avx2(s))))); }
+		else
+		{
+			__m256i t1 = _mm256_mullo_epi16(s, _mm256_add_epi16(_mm256_sub_epi16(c255, alpha16_avx2(d)), d));
+			__m256i t2 = _mm256_mullo_epi16(d, _mm256_sub_epi16(c255, alpha16_avx2(s)));
+			return div255_avx2(_mm256_adds_epu16(t1, t2));
+		}
+	}
+
+	//8 pixels per step:
+	template<CompositeOp op>
+	MINIGUI_TARGET_AVX2 inline void composite_span_avx2_op(Color8* dst, const Color8* src, int n)
+	{
+		const __m256i zero  = _mm256_setzero_si256();
+		const __m256i amask = _mm256_set1_epi32((int)0xFF000000u);
+		int i = 0;
+		for(; i + 8 <= n; i += 8)
+		{
+			__m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+			__m256i* p = (__m256i*)(dst + i);
+			if constexpr(op == CompositeOp::Add){ _mm256_storeu_si256(p, _mm256_adds_epu8(_mm256_loadu_si256(p), s)); continue; }
+			if constexpr(op == CompositeOp::SrcOver)
+			{
+				if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(s, zero)) == -1){ continue; }
+				if(_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(s, amask), amask)) == -1){ _mm256_storeu_si256(p, s); continue; }
+			}
+			__m256i d = _mm256_loadu_si256(p);
+			__m256i lo = composite4_avx2<op>(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero));
+			__m256i hi = composite4_avx2<op>(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero));
+			_mm256_storeu_si256(p, _mm256_packus_epi16(lo, hi));
+		}
+		composite_span_sse2_op<op>(dst + i, src + i, n - i);
+	}
+
+	MINIGUI_TARGET_AVX2 inline void composite_span_avx2(Color8* dst, const Color8* src, int n, CompositeOp op)
+	{
+		switch(op)
+		{
+		case CompositeOp::Copy:     composite_span_scalar(dst, src, n, op);                   break;
+		case CompositeOp::SrcOver:  composite_span_avx2_op<CompositeOp::SrcOver >(dst, src, n); break;
+		case CompositeOp::Add:      composite_span_avx2_op<CompositeOp::Add     >(dst, src, n); break;
+		case CompositeOp::Multiply: composite_span_avx2_op<CompositeOp::Multiply>(dst, src, n); break;
+		}
+	}
+#endif
+
+	struct Dispatch
+	{
+		Level level;
+		void (*fill_span)(Color8*, int, Color8);
+		void (*blend_mask_span)(Color8*, const unsigned char*, int, Color8);
+		unsigned int (*edge_mask8)(const int32_t*, const int32_t*);
+		void (*composite_span)(Color8*, const Color8*, int, CompositeOp);
+	};
+
+	inline Dispatch make_dispatch(Level l)
+	{
+		Dispatch d;
+		d.level           = Level::Scalar;
+		d.fill_span       = fill_span_scalar;
+		d.blend_mask_span = blend_mask_span_scalar;
+		d.edge_mask8      = edge_mask8_scalar;
+		d.composite_span  = composite_span_scalar;
+#ifdef MINIGUI_X86
+		if(l >= Level::SSE2)
+		{
+			d.level           = Level::SSE2;
+			d.fill_span       = fill_span_sse2;
+			d.blend_mask_span = blend_mask_span_sse2;
+			d.edge_mask8      = edge_mask8_sse2;
+			d.composite_span  = composite_span_sse2;
+		}
+		if(l >= Level::AVX2 && detect_level() == Level::AVX2)
+		{
+			d.level           = Level::AVX2;
+			d.fill_span       = fill_span_avx2;
+			d.blend_mask_span = blend_mask_span_avx2;
+			d.edge_mask8      = edge_mask8_avx2;
+			d.composite_span  = composite_span_avx2;
+		}
+#endif
+		return d;
+	}
+
+	inline Dispatch& dispatch(){ static Dispatch d = make_dispatch(detect_level()); return d; }
+
+	//Restricts the kernels to at most the given level, mostly useful for comparing the implementations:
+	inline Level set_level(Level l){ dispatch() = make_dispatch(l); return dispatch().level; }
+	inline Level level(){ return dispatch().level; }
+
+	inline void fill_span(Color8* dst, int n, Color8 c){ if(n > 0){ dispatch().fill_span(dst, n, c); } }
+
+	//Fills r (already clipped) in an image with the given row stride (in pixels):
+	inline void fill_rect(Color8* base, int stride, rect2i r, Color8 c)
+	{
+		if(r.w <= 0 || r.h <= 0){ return; }
+		Color8* p = base + (size_t)r.y * (size_t)stride + (size_t)r.x;
+		if(r.w == stride){ fill_span(p, r.w * r.h, c); return; }
+		for(int j=0; j<r.h; ++j, p += stride){ fill_span(p, r.w, c); }
+	}
+
+	inline unsigned int edge_mask8(const int32_t* e, const int32_t* a){ return dispatch().edge_mask8(e, a); }
+
+	inline void blend_mask_span(Color8* dst, const unsigned char* mask, int n, Color8 c){ if(n > 0){ dispatch().blend_mask_span(dst, mask, n, c); } }
+
+	//Blends a w x h coverage mask with solid color c over the image, strides are in elements:
+	inline void blend_mask(Color8* dst, int dstride, const unsigned char* mask, int mstride, int w, int h, Color8 c)
+	{
+		if(w <= 0 || h <= 0){ return; }
+		for(int j=0; j<h; ++j, dst += dstride, mask += mstride){ blend_mask_span(dst, mask, w, c); }
+	}
+
+	inline void composite_span(Color8* dst, const Color8* src, int n, CompositeOp op){ if(n > 0){ dispatch().composite_span(dst, src, n, op); } }
+
+	//Composites a w x h block of premultiplied pixels onto dst, strides are in elements:
+	inline void composite_rect(Color8* dst, int dstride, const Color8* src, int sstride, int w, int h, CompositeOp op)
+	{
+		if(w <= 0 || h <= 0){ return; }
+		for(int j=0; j<h; ++j, dst += dstride, src += sstride){ composite_span(dst, src, w, op); }
+	}
+
+	//Copies a w x h block of pixels, strides are in elements:
+	inline void copy_rect(Color8* dst, int dstride, const Color8* src, int sstride, int w, int h)
+	{
+		if(w <= 0 || h <= 0){ return; }
+		for(int j=0; j<h; ++j, dst += dstride, src += sstride){ memcpy(dst, src, (size_t)w * sizeof(Color8)); }
+	}
+}
@@ -1,8 +1,28 @@
 ﻿#include <string>
 #include <vector>
-#include <fstream>
-#include <iterator>
 #include <iostream>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <algorithm>
+#include <cstdlib>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 /*#define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -13,45 +33,93 @@
 
 #include "graphics_base.h"
 
-struct StbFont
+struct FontFace;
+
+//A font file mapped read-only and parsed once. stbtt reads the tables in place, so the OS pages in only the
+//tables and glyphs that are used, and the pages are clean and shared instead of a private copy per font.
+struct FontFile
 {
-	std::string filename;
-	stbtt_fontinfo font;
-	std::vector<unsigned char> fontfilebuffer;
+	std::string path;
+	unsigned id;                      //identifies the file in caches
+	const unsigned char* data;
+	size_t size;
+	bool mapped;                      //data is a mapping, otherwise it points into copy
+	std::vector<unsigned char> copy;
+	stbtt_fontinfo info;
 	int ascent, descent, linegap;
-	float max_asc, max_desc;//both positive, measured from baseline
+	float max_asc, max_desc;          //both positive, measured from baseline
 
-	int height(float height_to_scale_for) const
+	FontFile():id{0}, data{nullptr}, size{0}, mapped{false}{}
+	FontFile(FontFile const&) = delete;
+	~FontFile()
 	{
-		float scale = stbtt_ScaleForPixelHeight(&font, height_to_scale_for);
-		return (int)(scale * (ascent - descent));
+		if(!mapped){ return; }
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+#else
+		munmap((void*)data, size);
+#endif
 	}
 
-	int get_dx(float height) const
+	//maps the file, or reads it in one go if it cannot be mapped:
+	bool map_file(std::string const& fn)
 	{
-		float scale = stbtt_ScaleForPixelHeight(&font, height);
-		int advance, lsb;
-		stbtt_GetCodepointHMetrics(&font, 'A', &advance, &lsb);
-		return (int)(advance * scale);
+#ifdef _WIN32
+		HANDLE file = CreateFileA(fn.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if(file == INVALID_HANDLE_VALUE){ std::cout << "Cannot open font file: " << fn << "\n"; return false; }
+		LARGE_INTEGER sz;
+		if(!GetFileSizeEx(file, &sz) || sz.QuadPart <= 0){ std::cout << "Cannot read font file: " << fn << "\n"; CloseHandle(file); return false; }
+		size = (size_t)sz.QuadPart;
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		void* p = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if(mapping){ CloseHandle(mapping); } //the view keeps the mapping alive
+		if(p){ data = (const unsigned char*)p; mapped = true; }
+		else
+		{
+			copy.resize(size);
+			size_t got = 0;
+			while(got < size)
+			{
+				DWORD r = 0;
+				if(!ReadFile(file, copy.data() + got, (DWORD)std::min<size_t>(size - got, 1u << 30), &r, nullptr) || r == 0){ break; }
+				got += r;
+			}
+			if(got < size){ std::cout << "Cannot read font file: " << fn << "\n"; CloseHandle(file); return false; }
+			data = copy.data();
+		}
+		CloseHandle(file);
+#else
+		int fd = ::open(fn.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd < 0){ std::cout << "Cannot open font file: " << fn << "\n"; return false; }
+		struct stat st;
+		if(fstat(fd, &st) != 0 || st.st_size <= 0){ std::cout << "Cannot read font file: " << fn << "\n"; close(fd); return false; }
+		size = (size_t)st.st_size;
+		auto p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(p != MAP_FAILED){ data = (const unsigned char*)p; mapped = true; }
+		else
+		{
+			copy.resize(size);
+			size_t got = 0;
+			while(got < size){ auto r = pread(fd, copy.data() + got, size - got, (off_t)got); if(r <= 0){ break; } got += (size_t)r; }
+			if(got < size){ std::cout << "Cannot read font file: " << fn << "\n"; close(fd); return false; }
+			data = copy.data();
+		}
+		close(fd);
+#endif
+		return true;
 	}
 
-	int xdist(int nch, float height) const
+	bool load(std::string const& fn)
 	{
-		int dx = get_dx(height);
-		return (int)(nch * dx);
-	}
+		path = fn;
+		if(!map_file(fn)){ return false; }
 
-	bool init(std::string const& fn)
-	{
-		filename = fn;
-		std::ifstream fontfile(filename, std::ios::binary );
-		if(!fontfile.is_open()){ std::cout << "Cannot open font file: " << filename << "\n"; return false; }
-		fontfilebuffer = std::vector<unsigned char>(std::istreambuf_iterator<char>(fontfile), {});
-
-		int res = stbtt_InitFont(&font, (const unsigned char*)fontfilebuffer.data(), 0);
+		int res = stbtt_InitFont(&info, data, 0);
 		if(res == 0){ std::cout << "stbtt_InitFont failed\n"; return false; }
+		static unsigned lastId = 0;
+		id = ++lastId;
 
-		stbtt_GetFontVMetrics(&font, &ascent, &descent, &linegap);
+		stbtt_GetFontVMetrics(&info, &ascent, &descent, &linegap);
 
 		//font metrics seems to be unreliable in some cases so we measure all chars before rendering to get bounds:
 		//measure font max asc, desc:
@@ -63,7 +131,7 @@ struct StbFont
 		auto measure_char = [&](auto ch)
 		{
 			int x0, y0, x1, y1;
-			stbtt_GetCodepointBitmapBox(&font, ch, 1.0f, 1.0f, &x0, &y0, &x1, &y1);
+			stbtt_GetCodepointBitmapBox(&info, ch, 1.0f, 1.0f, &x0, &y0, &x1, &y1);
 			max_asc  = (float)std::min(max_asc,  (float)y0);
 			max_desc = (float)std::max(max_desc, (float)y1);
 		};
@@ -72,81 +140,328 @@ struct StbFont
 
 		max_asc  = -max_asc;
 
-		std::cout << "Loaded font file: " << filename << "\n";
+		std::cout << "Loaded font file: " << fn << (mapped ? "" : " (copied)") << "\n";
 		std::cout << "Ascent / descent: " << max_asc << ", " << max_desc << "\n";
 		return true;
 	}
 };
 
-int get_advance(wchar_t ch, StbFont const& font, float height)
+//The open font files by canonical path. A file stays mapped while a font uses it.
+struct FontRegistry
+{
+	std::mutex mutex;
+	std::unordered_map<std::string, std::weak_ptr<FontFile const>> files;
+
+	static FontRegistry& instance(){ static FontRegistry r; return r; }
+
+	std::shared_ptr<FontFile const> open(std::string const& fn)
+	{
+		std::string key = fn;
+#ifdef _WIN32
+		char full[_MAX_PATH];
+		if(_fullpath(full, fn.c_str(), _MAX_PATH)){ key = full; }
+#else
+		if(auto p = realpath(fn.c_str(), nullptr)){ key = p; free(p); }
+#endif
+		std::lock_guard<std::mutex> lock(mutex);
+		if(auto f = files[key].lock()){ return f; }
+		auto f = std::make_shared<FontFile>();
+		if(!f->load(fn)){ files.erase(key); return nullptr; }
+		files[key] = f;
+		return f;
+	}
+};
+
+struct StbFont
+{
+	unsigned id = 0; //identifies the font file in caches, fonts of the same file share it
+	std::string filename;
+	std::shared_ptr<FontFile const> file; //keeps the data of font alive
+	stbtt_fontinfo font;
+	int ascent, descent, linegap;
+	float max_asc, max_desc;//both positive, measured from baseline
+	mutable std::unordered_map<uint32_t, std::shared_ptr<FontFace>> faces; //by the bits of the pixel height
+
+	//the face for a pixel height, created on first use:
+	FontFace const& face(float height) const;
+
+	int height(float height_to_scale_for) const;
+	int get_dx(float height) const;
+	int xdist(int nch, float height) const { return (int)(nch * get_dx(height)); }
+
+	//shares the file with the other fonts loaded from it:
+	bool init(std::string const& fn)
+	{
+		filename = fn;
+		auto f = FontRegistry::instance().open(fn);
+		if(!f){ return false; }
+		file     = f;
+		id       = f->id;
+		font     = f->info;
+		ascent   = f->ascent;  descent  = f->descent; linegap = f->linegap;
+		max_asc  = f->max_asc; max_desc = f->max_desc;
+		faces.clear();
+		return true;
+	}
+};
+
+//Rasterized glyphs keyed by (font, codepoint, scale), packed into shelves of one A8 atlas.
+//When the atlas is full the least recently used shelf is evicted together with its glyphs.
+struct GlyphCache
 {
-	float scale = stbtt_ScaleForPixelHeight(&font.font, height);
-	int advance, lsb;
-	stbtt_GetCodepointHMetrics(&font.font, ch, &advance, &lsb);
-	return (int)(advance * scale);
+	struct Key
+	{
+		unsigned font; char32_t cp; uint32_t scale; //bits of the float scale
+		bool operator==(Key const& k) const { return font == k.font && cp == k.cp && scale == k.scale; }
+	};
+	struct KeyHash
+	{
+		size_t operator()(Key const& k) const { return (((size_t)k.font * 0x9E3779B97F4A7C15ull) ^ ((size_t)k.cp << 32) ^ (size_t)k.scale) * 0xBF58476D1CE4E5B9ull; }
+	};
+	struct Glyph
+	{
+		int x0, y0, w, h; //bitmap box relative to the pen position on the baseline
+		int ax, ay;       //position in the atlas
+		int shelf;
+	};
+	struct Shelf
+	{
+		int y, h, used;
+		uint64_t stamp;
+		std::vector<Key> keys;
+	};
+
+	Image2<unsigned char> atlas;
+	std::vector<Shelf> shelves;
+	std::unordered_map<Key, Glyph, KeyHash> glyphs;
+	uint64_t stamp;
+	int top; //first row not covered by a shelf
+	std::mutex mutex; //lock around a batch of get calls
+
+	GlyphCache(int w = 1024, int h = 1024):stamp{0}, top{0}{ atlas.resize({w, h}, 0); }
+
+	static GlyphCache& instance(){ static GlyphCache cache; return cache; }
+
+	void clear(){ shelves.clear(); glyphs.clear(); top = 0; }
+
+	//the glyph of cp, rasterized on first use, nullptr if it cannot fit the atlas. Valid until the next get:
+	Glyph const* get(StbFont const& font, char32_t cp, float scale){ return get(font.id, font.font, cp, scale); }
+
+	Glyph const* get(unsigned font, stbtt_fontinfo const& info, char32_t cp, float scale)
+	{
+		Key key{font, cp, 0};
+		memcpy(&key.scale, &scale, sizeof(key.scale));
+		auto it = glyphs.find(key);
+		if(it != glyphs.end())
+		{
+			if(it->second.shelf >= 0){ shelves[it->second.shelf].stamp = ++stamp; }
+			return &it->second;
+		}
+
+		Glyph g;
+		int x1, y1;
+		stbtt_GetCodepointBitmapBox(&info, cp, scale, scale, &g.x0, &g.y0, &x1, &y1);
+		g.w = x1 - g.x0; g.h = y1 - g.y0;
+		g.ax = 0; g.ay = 0; g.shelf = -1;
+		if(g.w > 0 && g.h > 0)
+		{
+			if(g.w > atlas.w() || g.h > atlas.h()){ return nullptr; }
+			g.shelf = place(g.w, g.h);
+			auto& sh = shelves[g.shelf];
+			g.ax = sh.used; g.ay = sh.y;
+			sh.used += g.w;
+			sh.stamp = ++stamp;
+			sh.keys.push_back(key);
+			for(int y=0; y<g.h; ++y){ memset(&atlas(g.ax, g.ay + y), 0, (size_t)g.w); }
+			stbtt_MakeCodepointBitmap(&info, &atlas(g.ax, g.ay), g.w, g.h, atlas.w(), scale, scale, cp);
+		}
+		return &(glyphs[key] = g);
+	}
+
+	//a shelf with room for w x h: a used one not much taller, a new one, the least recently used one of about
+	//the right height emptied, or a new one in the emptied atlas:
+	int place(int w, int h)
+	{
+		int best = -1;
+		for(int i=0; i<(int)shelves.size(); ++i)
+		{
+			auto const& s = shelves[i];
+			if(s.h >= h && s.h <= h + h / 2 + 2 && s.used + w <= atlas.w() && (best < 0 || s.h < shelves[best].h)){ best = i; }
+		}
+		if(best >= 0){ return best; }
+
+		int sh = std::min(h + 2, atlas.h()); //some room for taller glyphs of the same size, h <= atlas.h() is checked by get
+		if(top + sh > atlas.h())
+		{
+			for(int i=0; i<(int)shelves.size(); ++i)
+			{
+				if(shelves[i].h >= h && shelves[i].h <= 2 * sh && (best < 0 || shelves[i].stamp < shelves[best].stamp)){ best = i; }
+			}
+			if(best >= 0)
+			{
+				for(auto const& k : shelves[best].keys){ glyphs.erase(k); }
+				shelves[best].keys.clear();
+				shelves[best].used = 0;
+				return best;
+			}
+			clear(); //no shelf of about the right height, after this the new one fits
+		}
+		shelves.push_back(Shelf{top, sh, 0, 0, {}});
+		top += sh;
+		return (int)shelves.size() - 1;
+	}
+};
+
+//A laid out line of text: the pen position of each glyph, in pixels from the origin on the baseline.
+//Positions accumulate advances and kerning in font units and are rounded once, so long runs do not drift.
+struct GlyphRun
+{
+	std::basic_string<char32_t> cps;
+	std::vector<int> x;
+	int width;             //pen position after the last glyph
+	std::string key;       //bytes of the laid out string, to tell hash collisions apart
+	unsigned char unit;    //code unit size of the laid out string
+
+	GlyphRun():width{0}, unit{0}{}
+
+	int pen(int i) const { return i < (int)x.size() ? x[i] : width; } //pen position before glyph i
+};
+
+//A font at one pixel height: the scale, the vertical metrics and the horizontal metrics of the codepoints,
+//so measuring and laying out text needs no TrueType table lookups. Latin and Latin-1 are in a dense table,
+//the rest is looked up once and kept in a hash table.
+struct FontFace
+{
+	struct HMetrics{ int advance, lsb; }; //font units
+
+	unsigned id;                          //of the font file, for the glyph cache
+	stbtt_fontinfo font;                  //a copy, faces are shared by the copies of an StbFont and may outlive it
+	std::shared_ptr<FontFile const> file; //keeps the font data alive
+	float height, scale;
+	int pixelHeight;  //ascent to descent
+	int textHeight;   //rows of a rendered line, with the measured max ascent and descent and rounding room
+	int baseline;     //of a rendered line, from its top
+	int top;          //of the highest char above the baseline
+	int lineAdvance;  //baseline to baseline
+	bool kerning;     //the font has a kern or GPOS table
+	HMetrics dense[256];
+	mutable std::unordered_map<char32_t, HMetrics> sparse;
+	mutable std::vector<int16_t> denseKern; //pairs of codepoints under 256, looked up on first use
+
+	static constexpr size_t maxRuns = 4096; //the run cache is dropped as a whole when it grows over this
+	mutable std::unordered_map<size_t, GlyphRun> runs; //by the hash of the string, see layout_text
+
+	FontFace(StbFont const& f, float height_):id{f.id}, font(f.font), file{f.file}, height{height_}
+	{
+		scale       = stbtt_ScaleForPixelHeight(&f.font, height);
+		pixelHeight = (int)(scale * (f.ascent - f.descent));
+		textHeight  = (int)((f.max_asc + f.max_desc) * scale + 2);
+		baseline    = (int)(f.max_asc * scale + 1);
+		top         = baseline - (int)(f.max_asc * scale);
+		lineAdvance = (int)((f.max_desc + f.max_asc + f.linegap) * scale);
+		kerning     = f.font.kern != 0 || f.font.gpos != 0;
+		for(int cp=0; cp<256; ++cp){ stbtt_GetCodepointHMetrics(&f.font, cp, &dense[cp].advance, &dense[cp].lsb); }
+	}
+
+	HMetrics const& metrics(char32_t cp) const
+	{
+		if(cp < 256){ return dense[cp]; }
+		auto it = sparse.find(cp);
+		if(it != sparse.end()){ return it->second; }
+		HMetrics m;
+		stbtt_GetCodepointHMetrics(&font, (int)cp, &m.advance, &m.lsb);
+		return sparse[cp] = m;
+	}
+
+	int advance(char32_t cp) const { return (int)(metrics(cp).advance * scale); }
+	int lsb    (char32_t cp) const { return (int)(metrics(cp).lsb     * scale); }
+	//font units:
+	int kern(char32_t a, char32_t b) const
+	{
+		if(!kerning){ return 0; }
+		if(a >= 256 || b >= 256){ return stbtt_GetCodepointKernAdvance(&font, (int)a, (int)b); }
+		if(denseKern.empty()){ denseKern.assign(256*256, INT16_MIN); }
+		auto& k = denseKern[a*256 + b];
+		if(k == INT16_MIN){ k = (int16_t)stbtt_GetCodepointKernAdvance(&font, (int)a, (int)b); }
+		return k;
+	}
+};
+
+FontFace const& StbFont::face(float height) const
+{
+	uint32_t key; memcpy(&key, &height, sizeof(key));
+	auto& f = faces[key];
+	if(!f){ f = std::make_shared<FontFace>(*this, height); }
+	return *f;
 }
 
+int StbFont::height(float height_to_scale_for) const { return face(height_to_scale_for).pixelHeight; }
+int StbFont::get_dx(float height) const { return face(height).advance('A'); }
+
+int get_advance(wchar_t ch, FontFace const& face){ return face.advance((char32_t)ch); }
+int get_advance(wchar_t ch, StbFont const& font, float height){ return get_advance(ch, font.face(height)); }
+
 //assumes monospace, assumes no newline
 template<typename Str>
-size2<int> measure_small_string_monospace(Str const& str, StbFont const& font, float height)
+size2<int> measure_small_string_monospace(Str const& str, FontFace const& face)
 {
 	auto cps = str.to_codepoints();
-	float scale = stbtt_ScaleForPixelHeight(&font.font, height);
-	int baseline = (int)(font.ascent * scale);
-	int advance, lsb;
-	stbtt_GetCodepointHMetrics(&font.font, 'A', &advance, &lsb);
-	int dx = (int)(advance * scale);
-	int h = (int)((font.ascent - font.descent)*scale);
+	int dx = face.advance('A');
 	int w = (int)(dx * cps.size());
-	return {w, h};
+	return {w, face.pixelHeight};
 }
 
+template<typename Str>
+size2<int> measure_small_string_monospace(Str const& str, StbFont const& font, float height){ return measure_small_string_monospace(str, font.face(height)); }
+
 //assumes monospace, assumes no newline
 template<typename Str>
-PrerenderedText render_small_string_monospace(Str const& str, StbFont const& font, float height)
+PrerenderedText render_small_string_monospace(Str const& str, FontFace const& face)
 {
 	PrerenderedText rt;
-	if(height < 3.0f){ return rt; }
+	if(face.height < 3.0f){ return rt; }
 	auto  cps   = str.to_codepoints();
 	int   n     = (int)cps.size();
-	float scale = stbtt_ScaleForPixelHeight(&font.font, height);
-
-	int advance = 0, leftsidebearing = 0;
-	{
-		char32_t ch0 = (int)'A';
-		if(cps.size() > 0){ ch0 = cps[0]; }
-		stbtt_GetCodepointHMetrics(&font.font, ch0, &advance, &leftsidebearing);
-	}
+	float scale = face.scale;
+	auto const& font = face.font;
 
-	auto dw = (int)(advance * scale);                             //the char spacing
-	int x00 = (int)(leftsidebearing * scale) + 1*dw;              //1 extra char space at left
+	auto const& m0 = face.metrics(cps.size() > 0 ? cps[0] : (char32_t)'A');
+	auto dw = (int)(m0.advance * scale);                          //the char spacing
+	int x00 = (int)(m0.lsb * scale) + 1*dw;                       //1 extra char space at left
 	int w   = x00 + n * dw + 1*dw;                                //2 char extra width at edges
-	int h   = (int)((font.max_asc + font.max_desc) * scale + 2);  //2 pixel extra space due to rounding
-	int baseline = (int)(font.max_asc * scale + 1);				  //baseline position measured from top, added 1 to compensate rounding
+	int h   = face.textHeight;                                    //2 pixel extra space due to rounding
+	int baseline = face.baseline;                                 //baseline position measured from top, added 1 to compensate rounding
 	rt.baseline  = baseline;
-	rt.text_align_box.y = baseline - (int)(font.max_asc * scale); //top of highest char
+	rt.text_align_box.y = face.top;                               //top of highest char
 	rt.text_align_box.x = x00;                                    //left align edge, character may extend more to the left
 	rt.text_align_box.h = h;
-	rt.dh               = (int)((font.max_desc + font.max_asc + font.linegap) * scale); // total height to next baseline
+	rt.dh               = face.lineAdvance;                       // total height to next baseline
 	rt.resize(w, h);
 
 	if(cps.size() > 0)
 	{
+		auto& cache = GlyphCache::instance();
+		std::lock_guard<std::mutex> lock(cache.mutex);
 		int chpos = 0;
 		auto ch = cps[chpos];
 		int last_x = x00;
 		while(ch != 0)
 		{	
 			int xpos = (int)(x00 + dw * chpos);
-			
-			int x0, y0, x1, y1;
-			stbtt_GetCodepointBitmapBox(&font.font, ch, scale, scale, &x0, &y0, &x1, &y1);
-
-			int advance, leftsidebearing;
-			stbtt_GetCodepointHMetrics(&font.font, ch, &advance, &leftsidebearing);
-			//auto lsb_scaled = (int)(leftsidebearing * scale);
-
-			stbtt_MakeCodepointBitmap(&font.font, &rt.img[(baseline + y0)*w+xpos+x0], x1-x0, y1-y0, w, scale, scale, ch);
+			int x1;
+			if(auto g = cache.get(face.id, font, ch, scale))
+			{
+				//glyphs overwrite their whole box, like rasterizing in place does:
+				auto dst = rt.img.data.data() + (size_t)(baseline + g->y0)*w + xpos + g->x0;
+				for(int y=0; y<g->h; ++y){ memcpy(dst + (size_t)y*w, &cache.atlas(g->ax, g->ay + y), (size_t)g->w); }
+				x1 = g->x0 + g->w;
+			}
+			else
+			{
+				int x0, y0, y1;
+				stbtt_GetCodepointBitmapBox(&font, ch, scale, scale, &x0, &y0, &x1, &y1);
+				stbtt_MakeCodepointBitmap(&font, &rt.img[(baseline + y0)*w+xpos+x0], x1-x0, y1-y0, w, scale, scale, ch);
+			}
 			last_x = (ch == 32 ? xpos + dw : xpos + x1);
 			++chpos;
 			ch = cps[chpos];
@@ -157,6 +472,309 @@ PrerenderedText render_small_string_monospace(Str const& str, StbFont const& fon
 	return rt;
 }
 
+template<typename Str>
+PrerenderedText render_small_string_monospace(Str const& str, StbFont const& font, float height){ return render_small_string_monospace(str, font.face(height)); }
+
+//Fills the pen positions of run.cps:
+void layout_codepoints(GlyphRun& run, FontFace const& face)
+{
+	int n = (int)run.cps.size();
+	run.x.resize(n);
+	long pen = 0; //font units
+	for(int i=0; i<n; ++i)
+	{
+		auto cp = run.cps[i];
+		if(i > 0){ pen += face.kern(run.cps[i-1], cp); }
+		run.x[i] = (int)std::lround(pen * face.scale);
+		pen += face.metrics(cp).advance;
+	}
+	run.width = (int)std::lround(pen * face.scale);
+}
+
+//Proportional layout of a single line, assumes no newline. The run is cached in the face by the string,
+//so laying out an unchanged string again is a hash lookup. The reference is valid until the next call with the same face.
+template<typename Str>
+GlyphRun const& layout_text(Str const& str, FontFace const& face)
+{
+	auto const& repr = str.repr;
+	auto unit = (unsigned char)sizeof(repr[0]);
+	std::string_view bytes((const char*)repr.data(), repr.size() * unit);
+	size_t key = std::hash<std::string_view>{}(bytes) ^ unit;
+
+	auto it = face.runs.find(key);
+	if(it != face.runs.end() && it->second.unit == unit && it->second.key == bytes){ return it->second; }
+	if(it == face.runs.end() && face.runs.size() >= FontFace::maxRuns){ face.runs.clear(); }
+
+	auto& run = face.runs[key];
+	run.key.assign(bytes.data(), bytes.size());
+	run.unit = unit;
+	run.cps  = str.to_codepoints();
+	layout_codepoints(run, face);
+	return run;
+}
+
+template<typename Str>
+size2<int> measure_text(Str const& str, FontFace const& face){ return {layout_text(str, face).width, face.pixelHeight}; }
+
+template<typename Str>
+size2<int> measure_text(Str const& str, StbFont const& font, float height){ return measure_text(str, font.face(height)); }
+
+//Rasterizes the glyphs [b, e) of a run with the pen of glyph b at the origin.
+//The image has 1 pixel margin around the ink, overlapping glyph boxes are combined with max.
+PrerenderedText render_run(GlyphRun const& run, int b, int e, FontFace const& face)
+{
+	PrerenderedText rt;
+	if(face.height < 3.0f){ return rt; }
+	auto const& font = face.font;
+	int ox    = run.pen(b);
+	int width = run.pen(e) - ox;
+
+	auto& cache = GlyphCache::instance();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	auto box = [&](int i, int& x0, int& y0, int& x1, int& y1)
+	{
+		if(auto g = cache.get(face.id, font, run.cps[i], face.scale)){ x0 = g->x0; y0 = g->y0; x1 = g->x0 + g->w; y1 = g->y0 + g->h; return; }
+		stbtt_GetCodepointBitmapBox(&font, run.cps[i], face.scale, face.scale, &x0, &y0, &x1, &y1);
+	};
+
+	int inkLeft = 0, inkRight = 0;
+	for(int i=b; i<e; ++i)
+	{
+		int x0, y0, x1, y1;
+		box(i, x0, y0, x1, y1);
+		if(x1 > x0){ inkLeft = std::min(inkLeft, run.x[i] - ox + x0); inkRight = std::max(inkRight, run.x[i] - ox + x1); }
+	}
+
+	int x00 = 1 + std::max(0, -inkLeft);                  //origin, glyphs may extend left of it
+	int w   = x00 + std::max(width, inkRight) + 1;
+	int h   = face.textHeight;
+	int baseline = face.baseline;
+	rt.baseline  = baseline;
+	rt.text_align_box.x = x00;
+	rt.text_align_box.y = face.top;
+	rt.text_align_box.w = width;
+	rt.text_align_box.h = h;
+	rt.dh               = face.lineAdvance;
+	rt.resize(w, h);
+
+	for(int i=b; i<e; ++i)
+	{
+		int xpos = x00 + run.x[i] - ox;
+		if(auto g = cache.get(face.id, font, run.cps[i], face.scale))
+		{
+			int ya = std::max(0, -(baseline + g->y0)), yb = std::min(g->h, h - (baseline + g->y0));
+			for(int y=ya; y<yb; ++y)
+			{
+				auto src = &cache.atlas(g->ax, g->ay + y);
+				auto dst = &rt.img(xpos + g->x0, baseline + g->y0 + y);
+				for(int x=0; x<g->w; ++x){ dst[x] = std::max(dst[x], src[x]); }
+			}
+		}
+		else
+		{
+			//larger than the whole atlas, rasterized aside and clipped:
+			int x0, y0, x1, y1;
+			stbtt_GetCodepointBitmapBox(&font, run.cps[i], face.scale, face.scale, &x0, &y0, &x1, &y1);
+			Image2<unsigned char> tmp; tmp.resize({x1 - x0, y1 - y0}, 0);
+			stbtt_MakeCodepointBitmap(&font, tmp.data.data(), tmp.w(), tmp.h(), tmp.w(), face.scale, face.scale, run.cps[i]);
+			for(int y=std::max(0, -(baseline + y0)); y<std::min(tmp.h(), h - (baseline + y0)); ++y)
+			{
+				for(int x=0; x<tmp.w(); ++x){ auto& d = rt.img(xpos + x0 + x, baseline + y0 + y); d = std::max(d, tmp(x, y)); }
+			}
+		}
+	}
+	return rt;
+}
+
+//Proportional counterpart of render_small_string_monospace, assumes no newline:
+template<typename Str>
+PrerenderedText render_text(Str const& str, FontFace const& face)
+{
+	if(face.height < 3.0f){ return PrerenderedText{}; }
+	auto const& run = layout_text(str, face);
+	return render_run(run, 0, (int)run.cps.size(), face);
+}
+
+template<typename Str>
+PrerenderedText render_text(Str const& str, StbFont const& font, float height){ return render_text(str, font.face(height)); }
+
+//Multi-line text, wrapped at spaces to a width, or inside a word when the word alone is wider.
+//Every hard line keeps its layout, its row breaks and its rasterized rows: editing or appending lays out only
+//the changed lines, a new width re-breaks only the lines that were or become wider than the width,
+//and rows are rasterized when they are first asked for. Rows are lineHeight() apart, the PrerenderedText::dh.
+struct Paragraph
+{
+	struct Line
+	{
+		GlyphRun run;
+		std::vector<int> breaks;           //row i covers the glyphs [breaks[2i], breaks[2i+1])
+		std::vector<PrerenderedText> rows; //an empty image until rasterized
+		int brokenFor;                     //the width the breaks are for, -2 when the line needs a new break
+		int widest;                        //pen width of the widest row
+
+		Line():brokenFor{-2}, widest{0}{}
+		int nRows() const { return (int)breaks.size() / 2; }
+	};
+
+	FontFace const* face;
+	int width;                //0 for no wrapping
+	std::vector<Line> lines;
+	std::vector<int> first;   //index of the first row of each line, with the row count at the end
+	int widest;
+	std::vector<int> scratch; //breaks being computed
+
+	Paragraph():face{nullptr}, width{0}, first{0}, widest{0}{}
+
+	int lineHeight() const { return face ? face->lineAdvance : 0; }
+	int nRows()      const { return first.back(); }
+	size2<int> size() const { return {widest, nRows() > 0 && face ? (nRows() - 1) * lineHeight() + face->textHeight : 0}; }
+
+	void setFace(FontFace const& f)
+	{
+		if(face == &f){ return; }
+		face = &f;
+		for(auto& l : lines){ relayout(l); }
+		reflow();
+	}
+
+	void setWidth(int w)
+	{
+		w = std::max(0, w);
+		if(w == width){ return; }
+		width = w;
+		reflow();
+	}
+
+	//keeps the lines that did not change:
+	void setText(std::basic_string<char32_t> const& text)
+	{
+		size_t i = 0, p = 0;
+		for(;; ++i)
+		{
+			auto q = text.find(U'\n', p);
+			auto line = std::basic_string_view<char32_t>(text).substr(p, q == text.npos ? text.npos : q - p);
+			if(i == lines.size()){ lines.emplace_back(); }
+			if(lines[i].brokenFor == -2 || line != lines[i].run.cps){ lines[i].run.cps.assign(line); relayout(lines[i]); }
+			if(q == text.npos){ break; }
+			p = q + 1;
+		}
+		lines.resize(i + 1);
+		reflow();
+	}
+
+	void append(std::basic_string<char32_t> const& text)
+	{
+		if(lines.empty()){ lines.emplace_back(); }
+		size_t p = 0;
+		for(;;)
+		{
+			auto q = text.find(U'\n', p);
+			lines.back().run.cps.append(text, p, q == text.npos ? text.npos : q - p);
+			relayout(lines.back());
+			if(q == text.npos){ break; }
+			lines.emplace_back();
+			p = q + 1;
+		}
+		reflow();
+	}
+
+	template<typename Str> void setText(Str const& str){ setText(str.to_codepoints()); }
+	template<typename Str> void append (Str const& str){ append (str.to_codepoints()); }
+
+	void clear(){ lines.clear(); first.assign(1, 0); widest = 0; }
+
+	//row r, rasterized on first use:
+	PrerenderedText const& row(int r)
+	{
+		int i = (int)(std::upper_bound(first.begin(), first.end(), r) - first.begin()) - 1;
+		auto& l = lines[i];
+		auto& pt = l.rows[r - first[i]];
+		if(pt.img.w() == 0){ int j = 2 * (r - first[i]); pt = render_run(l.run, l.breaks[j], l.breaks[j+1], *face); }
+		return pt;
+	}
+
+	//calls f(row, y) for the rows overlapping [y0, y1), y is the top of the row from the top of the paragraph:
+	template<typename F>
+	void forRows(int y0, int y1, F&& f)
+	{
+		int lh = lineHeight();
+		if(lh <= 0){ return; }
+		int r0 = std::max(0, (y0 - face->textHeight) / lh), r1 = std::min(nRows(), (y1 + lh - 1) / lh);
+		for(int r=r0; r<r1; ++r){ f(row(r), r * lh); }
+	}
+
+	void relayout(Line& l)
+	{
+		l.brokenFor = -2;
+		if(face){ layout_codepoints(l.run, *face); }
+	}
+
+	void reflow()
+	{
+		if(!face){ return; }
+		first.resize(lines.size() + 1);
+		widest = 0;
+		int rows = 0;
+		for(size_t i=0; i<lines.size(); ++i)
+		{
+			auto& l = lines[i];
+			if(l.brokenFor != width){ rebreak(l); }
+			first[i] = rows;
+			rows += l.nRows();
+			widest = std::max(widest, l.widest);
+		}
+		first.back() = rows;
+	}
+
+	void rebreak(Line& l)
+	{
+		auto const& r = l.run;
+		int n = (int)r.cps.size();
+		//a line that fit before and fits now keeps its only row, a row trimmed at a narrower width does not count:
+		bool fits = width <= 0 || r.width <= width;
+		if(fits && l.brokenFor != -2 && l.nRows() == 1 && l.breaks[0] == 0 && l.breaks[1] == n){ l.brokenFor = width; return; }
+
+		auto& br = scratch;
+		br.clear();
+		if(fits){ br.push_back(0); br.push_back(n); }
+		else
+		{
+			//the first glyph that ends past the width is found by bisection, the break is at the space run before it:
+			int b = 0;
+			while(true)
+			{
+				if(r.width - r.x[b] <= width){ br.push_back(b); br.push_back(n); break; }
+				int k = (int)(std::upper_bound(r.x.begin() + b + 1, r.x.end(), r.x[b] + width) - r.x.begin()) - 1;
+				k = std::max(k, b + 1);
+				if(k == n){ br.push_back(b); br.push_back(n); break; }
+				int e = k;
+				while(e > b && r.cps[e] != U' '){ --e; }
+				while(e > b && r.cps[e-1] == U' '){ --e; }
+				if(e == b){ e = k; }
+				br.push_back(b); br.push_back(e);
+				b = e;
+				while(b < n && r.cps[b] == U' '){ ++b; }
+				if(b == n){ break; }
+			}
+		}
+
+		bool relaid = l.brokenFor == -2;
+		l.brokenFor = width;
+		if(!relaid && br == l.breaks){ return; }
+
+		//rows with the same glyphs keep their rasterized image:
+		size_t nr = br.size() / 2;
+		for(size_t j=0; j<std::min(nr, l.rows.size()); ++j)
+		{
+			if(relaid || l.breaks[2*j] != br[2*j] || l.breaks[2*j+1] != br[2*j+1]){ l.rows[j] = PrerenderedText{}; }
+		}
+		l.rows.resize(nr);
+		l.breaks.assign(br.begin(), br.end());
+		l.widest = 0;
+		for(size_t j=0; j<nr; ++j){ l.widest = std::max(l.widest, r.pen(br[2*j+1]) - r.pen(br[2*j])); }
+	}
+};
+
 template<typename C>
 Image2<C> recolor(Image2<unsigned char> const& img, C const& bkcolor, C const& fgcolor )
 {
@@ -171,6 +789,23 @@ Image2<C> recolor(Image2<unsigned char> const& img, C const& bkcolor, C const& f
 	return res;
 }
 
+//Same as recolor, but mixes the premultiplied colors, so the result is premultiplied and can be composited
+//with SrcOver even if the colors are translucent:
+Image2<Color8> recolor_premultiplied(Image2<unsigned char> const& img, Color8 const& bkcolor, Color8 const& fgcolor)
+{
+	Image2<Color8> res; res.resize(img.size());
+	const int N = img.size().area();
+	const auto bk = premultiply(bkcolor);
+	const auto fg = premultiply(fgcolor);
+	for(int i=0; i<N; ++i)
+	{
+		const unsigned int A = img[i], nA = 255 - A;
+		auto f = [=](unsigned int b, unsigned int c){ return (unsigned char)div255(b * nA + c * A); };
+		res[i] = Color8{ f(bk.b, fg.b), f(bk.g, fg.g), f(bk.r, fg.r), f(bk.a, fg.a) };
+	}
+	return res;
+}
+
 /*template<typename T, int ch = sizeof(T) / sizeof(unsigned char), typename Q = std::enable_if_t<(ch > 0 && ch <= 4 && std::is_integral_v<T>), void>>
 void save_image_png(std::string const& fn, Image2<unsigned char> const& img)
 {
@@ -12,6 +12,8 @@ namespace UI2
 		StbFont font;
 		Color8  bg, fg;
 		float   height;
+
+		FontFace const& face() const { return font.face(height); }
 	};
 
 	enum class HContentAlign { Fill = 255, Left = 2, Center, Right  };
@@ -35,8 +37,22 @@ namespace UI2
 	template<typename T> struct ValueRenderer;
 	template<typename T> struct MultiValueRenderer;
 
+	//Bitmaps can be stored premultiplied, they are then composited with SrcOver, so translucent styles layer correctly:
+	struct BitmapMode
+	{
+		bool premultiplied = false;
+
+		void setPremultiplied(bool b){ premultiplied = b; }
+		Image2<Color8> colorize(Image2<unsigned char> const& img, Style const& s) const { return premultiplied ? recolor_premultiplied(img, s.bg, s.fg) : recolor(img, s.bg, s.fg); }
+		void blit(Image2<Color8> const& bitmap, rect2i rct, SoftwareRenderer& sr) const
+		{
+			if(premultiplied){ sr.composite(bitmap, rct.x, rct.y, CompositeOp::SrcOver); }
+			else             { sr.copy_image(bitmap, rct.x, rct.y); }
+		}
+	};
+
 	template<typename T>
-	struct ValueRendererBase
+	struct ValueRendererBase : BitmapMode
 	{
 		Image2<Color8> bitmap;
 		T*     p;
@@ -59,8 +75,8 @@ namespace UI2
 			if(p && s)
 			{
 				utf8string str(*p);
-				auto pt = render_small_string_monospace(str, s->font, s->height);
-				bitmap = recolor(pt.img, s->bg, s->fg);
+				auto pt = render_text(str, s->face());
+				bitmap = colorize(pt.img, *s);
 			}
 		}
 
@@ -69,7 +85,7 @@ namespace UI2
 
 		void draw(rect2i rct, SoftwareRenderer& sr)
 		{
-			sr.copy_image(bitmap, rct.x, rct.y);
+			blit(bitmap, rct, sr);
 		}
 	};
 
@@ -79,8 +95,8 @@ namespace UI2
 		{
 			if(p && s)
 			{
-				auto pt = render_small_string_monospace(*p, s->font, s->height);
-				bitmap = recolor(pt.img, s->bg, s->fg);
+				auto pt = render_text(*p, s->face());
+				bitmap = colorize(pt.img, *s);
 			}
 		}
 
@@ -89,7 +105,7 @@ namespace UI2
 
 		void draw(rect2i rct, SoftwareRenderer& sr)
 		{
-			sr.copy_image(bitmap, rct.x, rct.y);
+			blit(bitmap, rct, sr);
 		}
 	};
 
@@ -109,6 +125,7 @@ namespace UI2
 		int    nElems() const { return r.nElems(); }
 		void   setTarget(T&     v){ r.setTarget(v); }
 		void   setStyle(Style& s){ r.setStyle(s); }
+		void   setPremultiplied(bool b){ r.setPremultiplied(b); }
 		void   update(){ r.update(); }
 		size2i getSize() const { return r.getSize(); }
 		void   draw(rect2i rct, SoftwareRenderer& sr){ r.draw(rct, sr); }
@@ -132,7 +149,7 @@ namespace UI2
 	};
 
 	template<typename T>
-	struct MultiValueRendererBase
+	struct MultiValueRendererBase : BitmapMode
 	{
 		std::vector<Image2<Color8>> bitmap;
 		T*     p;
@@ -160,8 +177,8 @@ namespace UI2
 				for(int i=0; i<n; ++i)
 				{
 					utf8string str((*p)[i]);
-					auto pt = render_small_string_monospace(str, s->font, s->height);
-					bitmap[i] = recolor(pt.img, s->bg, s->fg);
+					auto pt = render_text(str, s->face());
+					bitmap[i] = colorize(pt.img, *s);
 				}
 			}
 		}
@@ -180,7 +197,7 @@ namespace UI2
 			{
 				sr.filledrect(rct, s->bg);
 			}
-			sr.copy_image(bitmap[idx], rct.x, rct.y);
+			blit(bitmap[idx], rct, sr);
 		}
 	};
 
@@ -191,6 +208,7 @@ namespace UI2
 		int    nElems() const override { return r.nElems(); }
 		void   setTarget(T&     v){ r.setTarget(v); }
 		void   setStyle(Style& s){ r.setStyle(s); }
+		void   setPremultiplied(bool b){ r.setPremultiplied(b); }
 		void   update()override{ r.update(); }
 		size2i getElemSize(int i) const override { return r.getElemSize(i); }
 		void   drawElem(int i, rect2i rct, SoftwareRenderer& sr)override{ r.drawElem(i, rct, sr); }
@@ -441,22 +459,29 @@ namespace UI2
 	{
 		StbFont* font;
 		float height;
-		utf32string text;
-		PrerenderedText pt;
+		int wrap;         //width to wrap the text to, 0 for no wrapping
+		Paragraph para;
+
+		//the text may have several lines. Only the changed lines are laid out again, append for growing logs:
+		template<typename Str> void setText(Str const& str){ para.setText(str); }
+		template<typename Str> void append (Str const& str){ para.append(str); }
 
 		void preUpdate()
 		{
-			pt = render_small_string_monospace(text, *font, height);
+			para.setFace(font->face(height));
+			para.setWidth(wrap);
 		}
 
-		StaticText(){ layout->gap = {1,1}; }
+		StaticText():font{nullptr}, height{16}, wrap{0}{ layout->gap = {1,1}; }
 
-		size2i getSize() const override { return pt.img.size(); }
+		size2i getSize() const override { return para.size() + size2i{2, 0}; }
 
 		void draw(SoftwareRenderer& sr) override
 		{
 			sr.framedrect(layout->rect, color8(192,192,192), color8(128,128,128));
-			sr.prerendered_text_to_rect(pt, layout->content, color8(0,255,0));
+			auto c    = layout->content;
+			auto clip = intersect(c, sr.clipRect());
+			para.forRows(top(clip) - c.y, bottom(clip) - c.y, [&](PrerenderedText const& pt, int y){ sr.prerendered_text(pt, c.x + 1, c.y + y + pt.baseline, color8(0,255,0)); });
 		}
 	};
 
@@ -498,6 +523,9 @@ namespace UI2
 		virtual int         nElems() const { return 0; }
 		virtual size2i      getPreferredSize() const override { return {0,0}; }
 		virtual size2i      getElemSize(int i) const { return {0,0}; }
+
+		//elements fully outside the clip are skipped, the frame drawn by rect() ends at x+w, y+h inclusive:
+		static bool isDrawn(rect2i r, SoftwareRenderer const& sr){ return sr.isVisible(rect2i{r.x, r.y, r.w+1, r.h+1}); }
 	};
 
 	struct List : ListBase
@@ -531,7 +559,14 @@ namespace UI2
 		void draw(SoftwareRenderer& sr) override
 		{
 			sr.framedrect(layout->rect, color8(192,192,192), color8(64,64,64));
-			for(auto& c : childs){ c->draw(sr); }
+			sr.pushClip(layout->rect);
+			for(auto& c : childs)
+			{
+				if(!isDrawn(c->layout->rect, sr)){ continue; }
+				MINIGUI_PROFILE_WIDGET(c.get(), "List child");
+				c->draw(sr);
+			}
+			sr.popClip();
 			//sr.rect(content, color8(255,0,255));
 		}
 	};
@@ -590,8 +625,15 @@ namespace UI2
 			sr.framedrect(layout->rect, color8(192,192,192), color8(64,64,64));
 			if(proxy)
 			{
+				sr.pushClip(layout->rect);
 				int n = nElems();
-				for(int i=0; i<n; ++i){ proxy->drawElem(i, chs[i]->content, sr); }
+				for(int i=0; i<n; ++i)
+				{
+					if(!isDrawn(chs[i]->rect, sr)){ continue; }
+					MINIGUI_PROFILE_WIDGET(chs[i].get(), "ListData element");
+					proxy->drawElem(i, chs[i]->content, sr);
+				}
+				sr.popClip();
 			}
 			//sr.rect(content, color8(255,0,255));
 		}
@@ -0,0 +1,82 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+//A fixed set of worker threads. run(n, f) calls f(0) ... f(n-1) spread over the workers and the calling thread
+//and returns when all of them are finished.
+struct WorkerPool
+{
+	std::vector<std::thread> threads;
+	std::mutex               m;
+	std::condition_variable  cvstart, cvdone;
+	std::function<void(int)> job;
+	std::atomic<int>         next;
+	int                      njobs, active;
+	unsigned                 generation;
+	bool                     quit;
+
+	WorkerPool(int nworkers):next{0}, njobs{0}, active{0}, generation{0}, quit{false}
+	{
+		for(int i=0; i<nworkers; ++i){ threads.emplace_back([this]{ workerLoop(); }); }
+	}
+
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m);
+			quit = true;
+		}
+		cvstart.notify_all();
+		for(auto& t : threads){ t.join(); }
+	}
+
+	int size() const { return (int)threads.size() + 1; }
+
+	template<typename F>
+	void run(int n, F&& f)
+	{
+		if(threads.empty() || n < 2){ for(int i=0; i<n; ++i){ f(i); } return; }
+		{
+			std::lock_guard<std::mutex> lock(m);
+			job    = std::ref(f);
+			njobs  = n;
+			next   = 0;
+			active = (int)threads.size();
+			generation += 1;
+		}
+		cvstart.notify_all();
+		work();
+		std::unique_lock<std::mutex> lock(m);
+		cvdone.wait(lock, [&]{ return active == 0; });
+		job = nullptr;
+	}
+
+	void work()
+	{
+		for(int i = next++; i < njobs; i = next++){ job(i); }
+	}
+
+	void workerLoop()
+	{
+		unsigned seen = 0;
+		while(true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m);
+				cvstart.wait(lock, [&]{ return quit || generation != seen; });
+				if(quit){ return; }
+				seen = generation;
+			}
+			work();
+			{
+				std::lock_guard<std::mutex> lock(m);
+				active -= 1;
+				if(active == 0){ cvdone.notify_one(); }
+			}
+		}
+	}
+};